@@ -31,10 +31,17 @@ typedef struct
 #define LCD_BASE0        		((uint32_t)0x6C000000)
 #define LCD_BASE1        		((uint32_t)0x6C000800)
 
+// bus access of the whole driver; a build may define these beforehand to feed a display model instead of FSMC
+#ifndef LCD_CmdWrite
 #define LCD_CmdWrite(command)	*(volatile uint16_t *) (LCD_BASE0) = (command)
 #define LCD_DataWrite(data)		*(volatile uint16_t *) (LCD_BASE1) = (data)
 #define	LCD_StatusRead()		*(volatile uint16_t *) (LCD_BASE0) //if use read  Mcu interface DB0~DB15 needs increase pull high
 #define	LCD_DataRead()			*(volatile uint16_t *) (LCD_BASE1) //if use read  Mcu interface DB0~DB15 needs increase pull high
+// two data words in one store: the 16 bit FSMC bank splits it into two cycles, A0 changes but RS (A10) stays high
+#define LCD_DataWrite32(data)	*(volatile uint32_t *) (LCD_BASE1) = (data)
+// the data register as a DMA target, for transfers that bypass LCD_DataWrite
+#define LCD_DataPort			((volatile uint16_t *) (LCD_BASE1))
+#endif
 
 #define swap(a, b) { int16_t t = a; a = b; b = t; }
 
@@ -42,6 +49,30 @@ typedef struct
 #define ILI9341_PIXEL_HEIGHT 	320
 #define ILI9341_PIXEL_COUNT		ILI9341_PIXEL_WIDTH * ILI9341_PIXEL_HEIGHT
 
+// Bus trace recorder, size in 16 bit words (0 = compiled out). Trace format, one token per entry:
+//   0x0000 | cmd			command byte written by lcdWriteCommand
+//   0x4000 | n, word		the same data word n times (n = 2..0x3FFF)
+//   0x8000 | n			frame marker from lcdTraceFrame, n = frame number & 0x3FFF
+//   0xC000 | n, n words	n distinct data words
+// Pixel data moved by DMA (lcdBlitFromFlash) does not pass lcdWriteData and is not recorded.
+// Host/build/lcd_trace replays a trace dumped from RAM into a GRAM model, diffs two and reports each frame.
+#ifndef LCD_TRACE_WORDS
+#define LCD_TRACE_WORDS			0
+#endif
+
+// Solid fills of at least this many pixels are streamed by DMA2 in the background (0 = CPU only).
+// Works with the FSMC bus macros only; the next command written to the LCD waits for the fill to end.
+#ifndef LCD_DMA_FILL_MIN
+#define LCD_DMA_FILL_MIN		512
+#endif
+
+// Render queue, power of two. lcd*Async calls only queue the command and return a fence; the queue is run
+// by lcdQueueProcess() from PendSV at the lowest priority, lcdQueueKick() in SysTick retries deferred work.
+// The blocking calls are submit + lcdFenceWait, all drawing must come from thread mode.
+#ifndef LCD_QUEUE_LEN
+#define LCD_QUEUE_LEN			32
+#endif
+
 // Any LCD needs to implement these common methods, which allow the low-level
 // initialisation and pixel-setting details to be abstracted away from the
 // higher level drawing and graphics code.
@@ -81,6 +112,32 @@ typedef struct
   bool					hwscrolling;   // Whether the LCD support HW scrolling
 } lcdPropertiesTypeDef;
 
+// Window/MADCTL shadow counters, one bus write = one FSMC cycle
+typedef struct
+{
+  uint32_t				windowCalls;   // lcdSetWindow/lcdReadPixel address setups
+  uint32_t				savedWrites;   // CASET/PASET/MADCTL writes skipped because nothing changed
+} lcdBusStatsTypeDef;
+
+// Render queue back end counters
+typedef struct
+{
+  uint32_t				commands;      // queued commands executed
+  uint32_t				pixels;        // pixels written by them
+  uint32_t				cpuCycles;     // CPU time spent running them, DMA fill time not included
+} lcdQueueStatsTypeDef;
+
+// FSMC bank 4 timings chosen by lcdTuneBusTiming, in HCLK cycles
+typedef struct
+{
+  uint8_t				writeAddSet;   // BWTR4 ADDSET
+  uint8_t				writeDataSet;  // BWTR4 DATAST
+  uint8_t				readAddSet;    // BTR4 ADDSET
+  uint8_t				readDataSet;   // BTR4 DATAST
+  uint32_t				pixelsPerSecond; // CPU fill rate at the chosen write timing
+  bool					verified;      // false: GRAM did not read back even at the stock timings, nothing was changed
+} lcdBusTimingTypeDef;
+
 void LCD_ILI9341_init(void);
 
 
@@ -88,7 +145,9 @@ void              		lcdTest(void);
 void					lcdFillRGB(uint16_t color);
 void					lcdDrawPixel(uint16_t x, uint16_t y, uint16_t color);
 void              		lcdDrawHLine(uint16_t x0, uint16_t x1, uint16_t y, uint16_t color);
+uint32_t				lcdDrawHLineAsync(uint16_t x0, uint16_t x1, uint16_t y, uint16_t color);
 void              		lcdDrawVLine(uint16_t x, uint16_t y0, uint16_t y1, uint16_t color);
+uint32_t				lcdDrawVLineAsync(uint16_t x, uint16_t y0, uint16_t y1, uint16_t color);
 void 					lcdDrawLine(int16_t x1, int16_t y1, int16_t x2, int16_t y2, uint16_t color);
 void					lcdDrawRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color);
 void					lcdDrawRoundRect(int16_t x, int16_t y, int16_t w, int16_t h, int16_t r, uint16_t color);
@@ -98,11 +157,18 @@ void 					lcdDrawTriangle(int16_t x0, int16_t y0, int16_t x1, int16_t y1, int16_
 void					lcdFillCircle(int16_t x0, int16_t y0, int16_t r, uint16_t color);
 void					lcdFillCircleHelper(int16_t x0, int16_t y0, int16_t r, uint8_t cornername, int16_t delta, uint16_t color);
 void					lcdFillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t fillcolor);
+uint32_t				lcdFillRectAsync(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t fillcolor);
+uint32_t				lcdFillRGBAsync(uint16_t color);
+bool					lcdFenceDone(uint32_t fence);
+void					lcdFenceWait(uint32_t fence);
 void					lcdFillRoundRect(int16_t x, int16_t y, int16_t w, int16_t h, int16_t r, uint16_t color);
 void 					lcdFillTriangle(int16_t x0, int16_t y0, int16_t x1, int16_t y1, int16_t x2, int16_t y2, uint16_t color);
 void					lcdDrawImage(uint16_t x, uint16_t y, GUI_CONST_STORAGE GUI_BITMAP* pBitmap);
+void					lcdBlitFromFlash(uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint32_t flash_addr);
+uint32_t				lcdBlitFromFlashAsync(uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint32_t flash_addr);
 void              		lcdHome(void);
 void 					lcdDrawChar(int16_t x, int16_t y, unsigned char c, uint16_t color, uint16_t bg);
+uint32_t				lcdDrawCharAsync(int16_t x, int16_t y, unsigned char c, uint16_t color, uint16_t bg);
 void					lcdPrintf(const char *fmt, ...);
 void					lcdSetTextFont(sFONT* font);
 void					lcdSetTextColor(uint16_t c, uint16_t b);
@@ -126,5 +192,14 @@ sFONT*					lcdGetTextFont(void);
 lcdPropertiesTypeDef   	lcdGetProperties(void);
 uint16_t				lcdReadPixel(uint16_t x, uint16_t y);
 uint16_t 				lcdColor565(uint8_t r, uint8_t g, uint8_t b);
+lcdBusStatsTypeDef		lcdGetBusStats(bool reset);
+lcdQueueStatsTypeDef	lcdGetQueueStats(bool reset);
+lcdBusTimingTypeDef		lcdTuneBusTiming(uint8_t margin);
+lcdBusTimingTypeDef		lcdGetBusTiming(void);
+void					lcdQueueProcess(void);
+void					lcdQueueKick(void);
+void					lcdTraceStart(void);
+void					lcdTraceFrame(void);
+const uint16_t*			lcdTraceStop(uint32_t *words);
 
 #endif /* ILI9341_H_ */
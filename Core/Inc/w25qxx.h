@@ -65,22 +65,107 @@ extern "C"
 		uint32_t BlockSize;
 		uint32_t BlockCount;
 		uint32_t CapacityInKiloByte;
+		uint8_t Manufacturer;
+		uint8_t AddrBytes;
+		bool Use4ByteCmd;
+		bool Sfdp;
+		uint32_t EraseTime[4]; // typical ms for 4K, 32K, 64K and chip erase, 0xFFFFFFFF = not available
 		uint8_t StatusRegister1;
 		uint8_t StatusRegister2;
 		uint8_t StatusRegister3;
-		uint8_t Lock;
+		volatile uint8_t Lock;
+		uint32_t CacheHit;
+		uint32_t CacheMiss;
+		uint32_t Timeouts; // BUSY still set when an erase/program or a job step ran out of time
 
 	} w25qxx_t;
 
+	// Receives consecutive chunks of a streaming read while CS is still held low,
+	// so it must not call back into the w25qxx driver. Nor may it call the queued
+	// lcd* functions: a queued blit waits for the flash lock the stream is holding.
+	typedef void (*W25qxx_StreamSink_t)(uint8_t *pData, uint32_t Len);
+
+	typedef enum
+	{
+		W25QXX_JOB_ERASE_SECTOR = 0,
+		W25QXX_JOB_ERASE_BLOCK,
+		W25QXX_JOB_ERASE_CHIP,
+		W25QXX_JOB_PROGRAM,
+		W25QXX_JOB_PROGRAM_PIXELS, // uint16_t source, stored MSB first like W25qxx_WritePixels
+
+	} W25qxx_JobType_t;
+
+	typedef enum
+	{
+		W25QXX_JOB_IDLE = 0,
+		W25QXX_JOB_QUEUED,
+		W25QXX_JOB_BUSY,
+		W25QXX_JOB_DONE,
+		W25QXX_JOB_ERROR,
+
+	} W25qxx_JobState_t;
+
+	// scheduling class, lower value is served first. Reads are always INTERACTIVE.
+	typedef enum
+	{
+		W25QXX_PRIO_INTERACTIVE = 0,
+		W25QXX_PRIO_BACKGROUND,
+		W25QXX_PRIO_HOUSEKEEPING,
+		W25QXX_PRIO_COUNT,
+
+	} W25qxx_Prio_t;
+
+	// latency from request to completion: reads in us including the wait for the bus, jobs at 1 ms resolution
+	typedef struct
+	{
+		uint32_t Count;
+		uint32_t MaxUs;
+		uint64_t TotalUs;
+
+	} W25qxx_Stats_t;
+
+	typedef struct
+	{
+		uint32_t Address;
+		uint8_t *pBuffer;
+		uint32_t Len;
+
+	} W25qxx_ReadReq_t;
+
+	struct W25qxx_Job_s;
+	typedef void (*W25qxx_JobCallback_t)(struct W25qxx_Job_s *Job);
+
+	// Caller owned job, Address/Len in bytes. Erase jobs cover every sector/block touched
+	// by the range. pBuffer must stay valid until State reaches DONE or ERROR.
+	typedef struct W25qxx_Job_s
+	{
+		W25qxx_JobType_t Type;
+		uint32_t Address;
+		const uint8_t *pBuffer;
+		uint32_t Len;
+		W25qxx_JobCallback_t Callback;
+		W25qxx_Prio_t Priority;
+		volatile W25qxx_JobState_t State;
+		volatile uint32_t Done;
+		uint32_t SubmitTime;
+		struct W25qxx_Job_s *Next;
+
+	} W25qxx_Job_t;
+
 	extern w25qxx_t w25qxx;
+	extern W25qxx_Stats_t W25qxx_Stats[W25QXX_PRIO_COUNT];
 	//############################################################################
 	// in Page,Sector and block read/write functions, can put 0 to read maximum bytes
+	// blocking erase/write/program return false when BUSY outlives its timeout
 	//############################################################################
 	bool W25qxx_Init(void);
 
-	void W25qxx_EraseChip(void);
-	void W25qxx_EraseSector(uint32_t SectorAddr);
-	void W25qxx_EraseBlock(uint32_t BlockAddr);
+	bool W25qxx_EraseChip(void);
+	bool W25qxx_EraseSector(uint32_t SectorAddr);
+	bool W25qxx_EraseBlock(uint32_t BlockAddr);
+	bool W25qxx_EraseHalfBlock(uint32_t HalfBlockAddr);
+	// erases every sector touched by the range with the cheapest sector/32K/64K/chip mix
+	bool W25qxx_EraseRange(uint32_t Address, uint32_t NumByteToErase, bool SkipBlank);
 
 	uint32_t W25qxx_PageToSector(uint32_t PageAddress);
 	uint32_t W25qxx_PageToBlock(uint32_t PageAddress);
@@ -91,17 +176,56 @@ extern "C"
 	bool W25qxx_IsEmptyPage(uint32_t Page_Address, uint32_t OffsetInByte, uint32_t NumByteToCheck_up_to_PageSize);
 	bool W25qxx_IsEmptySector(uint32_t Sector_Address, uint32_t OffsetInByte, uint32_t NumByteToCheck_up_to_SectorSize);
 	bool W25qxx_IsEmptyBlock(uint32_t Block_Address, uint32_t OffsetInByte, uint32_t NumByteToCheck_up_to_BlockSize);
+	bool W25qxx_IsEmptyRange(uint32_t Address, uint32_t NumByteToCheck);
 
-	void W25qxx_WriteByte(uint8_t pBuffer, uint32_t Bytes_Address);
-	void W25qxx_WritePage(uint8_t *pBuffer, uint32_t Page_Address, uint32_t OffsetInByte, uint32_t NumByteToWrite_up_to_PageSize);
-	void W25qxx_WriteSector(uint8_t *pBuffer, uint32_t Sector_Address, uint32_t OffsetInByte, uint32_t NumByteToWrite_up_to_SectorSize);
-	void W25qxx_WriteBlock(uint8_t *pBuffer, uint32_t Block_Address, uint32_t OffsetInByte, uint32_t NumByteToWrite_up_to_BlockSize);
+	bool W25qxx_WriteByte(uint8_t pBuffer, uint32_t Bytes_Address);
+	bool W25qxx_WritePage(uint8_t *pBuffer, uint32_t Page_Address, uint32_t OffsetInByte, uint32_t NumByteToWrite_up_to_PageSize);
+	bool W25qxx_WriteSector(uint8_t *pBuffer, uint32_t Sector_Address, uint32_t OffsetInByte, uint32_t NumByteToWrite_up_to_SectorSize);
+	bool W25qxx_WriteBlock(uint8_t *pBuffer, uint32_t Block_Address, uint32_t OffsetInByte, uint32_t NumByteToWrite_up_to_BlockSize);
 
 	void W25qxx_ReadByte(uint8_t *pBuffer, uint32_t Bytes_Address);
 	void W25qxx_ReadBytes(uint8_t *pBuffer, uint32_t ReadAddr, uint32_t NumByteToRead);
 	void W25qxx_ReadPage(uint8_t *pBuffer, uint32_t Page_Address, uint32_t OffsetInByte, uint32_t NumByteToRead_up_to_PageSize);
 	void W25qxx_ReadSector(uint8_t *pBuffer, uint32_t Sector_Address, uint32_t OffsetInByte, uint32_t NumByteToRead_up_to_SectorSize);
 	void W25qxx_ReadBlock(uint8_t *pBuffer, uint32_t Block_Address, uint32_t OffsetInByte, uint32_t NumByteToRead_up_to_BlockSize);
+	void W25qxx_ReadBatch(const W25qxx_ReadReq_t *pReq, uint32_t NumReq);
+	// ReadByte and short ReadBytes go through a page cache, the benchmark needs _W25QXX_DEBUG
+	void W25qxx_CacheBenchmark(uint32_t NumReads);
+
+	// any length, across page/sector/block boundaries, into erased flash
+	bool W25qxx_Program(uint32_t WriteAddr, const uint8_t *pBuffer, uint32_t NumByteToWrite);
+	void W25qxx_ReadStream(uint32_t ReadAddr, uint32_t NumByteToRead, W25qxx_StreamSink_t Sink);
+	void W25qxx_ReadStreamDMA(uint32_t ReadAddr, uint32_t NumByteToRead, W25qxx_StreamSink_t Sink);
+	//############################################################################
+	// read-modify-write of any byte range. Writes to the same sector are merged in
+	// RAM and go out when another sector is touched or on W25qxx_UpdateFlush():
+	// unchanged pages are skipped, the sector is erased only for a 0->1 change.
+	// Call W25qxx_UpdateInvalidate() after changing that sector by other means.
+	//############################################################################
+	bool W25qxx_Update(uint32_t WriteAddr, const uint8_t *pBuffer, uint32_t NumByteToWrite);
+	bool W25qxx_UpdateFlush(void);
+	void W25qxx_UpdateInvalidate(void);
+	//############################################################################
+	// RGB565 pixels are kept MSB first (big endian) in flash, so 16 bit SPI frames
+	// deliver them ready for LCD_RAM. W25qxx_WritePixels does the swap on the way in
+	// and rejects an odd WriteAddr.
+	//############################################################################
+	void W25qxx_ReadStreamToPort(uint32_t ReadAddr, volatile uint16_t *Port, uint32_t NumPixelToRead);
+	void W25qxx_ReadPixels(uint16_t *pPixels, uint32_t ReadAddr, uint32_t NumPixelToRead);
+	bool W25qxx_WritePixels(const uint16_t *pPixels, uint32_t WriteAddr, uint32_t NumPixelToWrite);
+	//############################################################################
+	// non-blocking program/erase: jobs run one at a time by Priority, in submit order
+	// within a class, one command per W25qxx_JobProcess() call, which is hooked to SysTick. Reads outside the job
+	// range suspend a running sector/block erase or page program and resume it after.
+	// Submit rejects an empty range and one past the end of the chip. A step that times
+	// out ends the job with W25QXX_JOB_ERROR once BUSY drops, the next job waits until then.
+	//############################################################################
+	bool W25qxx_JobSubmit(W25qxx_Job_t *Job);
+	void W25qxx_JobProcess(void);
+	bool W25qxx_JobIsFinished(W25qxx_Job_t *Job);
+	// bus owned by a driver call or a queued job from its first command until it finishes. Only a hint
+	// for code that can preempt the owner: a read issued anyway waits in the lock for that owner.
+	bool W25qxx_IsBusy(void);
 //############################################################################
 #ifdef __cplusplus
 }
@@ -6,5 +6,21 @@
 #define _W25QXX_CS_PIN                Flash_CS_Pin
 #define _W25QXX_USE_FREERTOS          0
 #define _W25QXX_DEBUG                 0
+#ifndef _W25QXX_USE_LL
+#define _W25QXX_USE_LL                1 // drive SPI DR/SR directly for single bytes and headers, 0 = HAL calls
+#endif
+#define _W25QXX_USE_DMA               1 // ping-pong SPI RX DMA for ReadStreamDMA, needs hspi2 hdmarx/hdmatx
+#define _W25QXX_USE_UPDATE            1 // 4 KB RAM sector buffer for W25qxx_Update read-modify-write
+#define _W25QXX_CACHE_PAGES           8 // 256 byte pages kept in RAM for small reads, 0 = no cache
+#define _W25QXX_CACHE_MAX_READ        256 // ReadBytes longer than this bypass the cache
+#define _W25QXX_ERASE_PLAN_BLOCKS     256 // whole chip EraseRange keeps blank checks for this many 64K blocks, 2 bytes each
+#define _W25QXX_MERGE_GAP             16 // ReadBatch keeps one transaction across gaps up to this many bytes
+#define _W25QXX_STREAM_CHUNK          256 // bytes handed to the sink per call, multiple of 4
+#define _W25QXX_POLL_INTERVAL_US      5   // BUSY polling period while program/erase runs
+#define _W25QXX_SUSPEND_GAP_US        100 // minimum erase/program progress between two read suspends
+#define _W25QXX_TIMEOUT_PAGE_MS       5
+#define _W25QXX_TIMEOUT_SECTOR_MS     500
+#define _W25QXX_TIMEOUT_BLOCK_MS      2500
+#define _W25QXX_TIMEOUT_CHIP_MS       400000
 
 #endif
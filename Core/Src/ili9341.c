@@ -8,6 +8,16 @@
 #include <stdarg.h>
 #include <stdio.h>
 #include "ili9341.h"
+#include "w25qxx.h"
+#include "fsmc.h"
+
+// DMA fills write LCD_BASE1 directly, so they are only built on top of the FSMC bus macros
+#if (LCD_DMA_FILL_MIN > 0) && defined(LCD_DataWrite32)
+#define LCD_DMA_FILL	1
+#include "dma.h"
+#else
+#define LCD_DMA_FILL	0
+#endif
 
 enum {
   MemoryAccessControlNormalOrder,
@@ -28,10 +38,70 @@ static unsigned char lcdLandscapeConfig = 0;
 static unsigned char lcdPortraitMirrorConfig = 0;
 static unsigned char lcdLandscapeMirrorConfig = 0;
 
+// last CASET/PASET/MADCTL values sent, 0xFFFF = unknown (after reset)
+static unsigned short lcdShadowX0 = 0xFFFF, lcdShadowX1 = 0xFFFF;
+static unsigned short lcdShadowY0 = 0xFFFF, lcdShadowY1 = 0xFFFF;
+static unsigned short lcdShadowMadctl = 0xFFFF;
+static lcdBusStatsTypeDef lcdBusStats;
+
+// fences: every queued command takes the next number, commands finish in that order
+static volatile uint32_t lcdFenceIssued = 0;
+static volatile uint32_t lcdFenceCompleted = 0;
+
+// render queue, see LCD_QUEUE_LEN
+typedef enum
+{
+	LCD_CMD_FILL,	// solid color into the window x, y, w, h
+	LCD_CMD_CHAR,
+	LCD_CMD_BLIT
+} lcdCmdOpTypeDef;
+
+typedef struct
+{
+	lcdCmdOpTypeDef	op;
+	int16_t			x, y, w, h;
+	uint16_t		color, bg;
+	unsigned char	c;
+	sFONT*			font;		// taken at submit, lcdSetTextFont may run before the char is drawn
+	uint32_t		addr;
+	uint32_t		fence;
+} lcdCmdTypeDef;
+
+static lcdCmdTypeDef lcdQueue[LCD_QUEUE_LEN];
+static volatile uint32_t lcdQueueHead = 0;		// moved by thread mode only
+static volatile uint32_t lcdQueueTail = 0;		// moved by the back end only
+static lcdQueueStatsTypeDef lcdQueueStats;
+
+// bus timing calibration, a 64 x 8 test window in the top left corner
+#define LCD_TUNE_W		64
+#define LCD_TUNE_H		8
+static lcdBusTimingTypeDef lcdBusTiming;
+#if LCD_DMA_FILL
+static uint16_t lcdDmaColor;			// DMA source, must outlive the call that started the fill
+static volatile uint32_t lcdDmaLeft;	// pixels not yet handed to the DMA channel
+static volatile uint32_t lcdDmaFence;
+static volatile bool lcdDmaBusy = false;
+#endif
+
 static void				lcdDrawPixels(uint16_t x, uint16_t y, uint16_t *data, uint32_t dataLength);
 static void        		lcdReset(void);
+static void				lcdSetAddress(unsigned short x0, unsigned short y0, unsigned short x1, unsigned short y1);
+static void				lcdDrawRun(int16_t a0, int16_t a1, int16_t b, bool vertical, uint16_t color);
 static void        		lcdWriteCommand(unsigned char command);
 static void             lcdWriteData(unsigned short data);
+static void				lcdWriteColor(uint16_t color, uint32_t count);
+static void				lcdFillStart(uint16_t color, uint32_t count, uint32_t fence);
+static void				lcdFillWait(void);
+static bool				lcdFillBusy(void);
+static uint32_t			lcdQueueSubmit(lcdCmdTypeDef *cmd);
+static uint32_t			lcdQueueFill(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color);
+static void				lcdBusAcquire(void);
+static void				lcdDoDrawChar(int16_t x, int16_t y, unsigned char c, uint16_t color, uint16_t bg, sFONT *font);
+static void				lcdDoBlitFromFlash(uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint32_t flash_addr);
+static void				lcdTuneSetWrite(uint8_t addSet, uint8_t dataSet);
+static void				lcdTuneSetRead(uint8_t addSet, uint8_t dataSet);
+static bool				lcdTuneCheck(const lcdBusTimingTypeDef *test, const lcdBusTimingTypeDef *safe);
+static void				lcdTuneLower(uint8_t *field, uint8_t min, lcdBusTimingTypeDef *test, const lcdBusTimingTypeDef *safe);
 static unsigned short	lcdReadData(void);
 
 static unsigned char    lcdBuildMemoryAccessControlConfig(
@@ -125,6 +195,10 @@ void LCD_ILI9341_init(void)
     uint32_t i2;
     uint8_t counter;
 
+    // cycle counter for the render queue statistics
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
 
 
     lcdPortraitConfig = lcdBuildMemoryAccessControlConfig(
@@ -212,12 +286,19 @@ void lcdTest(void)
 
 void lcdFillRGB(uint16_t color)
 {
-  lcdSetWindow(0, 0, lcdProperties.width - 1, lcdProperties.height - 1);
-  int dimensions = lcdProperties.width * lcdProperties.height;
-  while(dimensions--)
-  {
-    lcdWriteData(color);
-  }
+  lcdFenceWait(lcdFillRGBAsync(color));
+}
+
+/**
+ * \brief Queues a whole screen fill, large fills run on DMA2
+ *
+ * \param color	Color
+ *
+ * \return Fence to pass to lcdFenceDone/lcdFenceWait
+ */
+uint32_t lcdFillRGBAsync(uint16_t color)
+{
+  return lcdQueueFill(0, 0, lcdProperties.width, lcdProperties.height, color);
 }
 
 /**
@@ -240,6 +321,11 @@ void lcdDrawPixel(uint16_t x, uint16_t y, uint16_t color)
 }
 
 void lcdDrawHLine(uint16_t x0, uint16_t x1, uint16_t y, uint16_t color)
+{
+  lcdFenceWait(lcdDrawHLineAsync(x0, x1, y, color));
+}
+
+uint32_t lcdDrawHLineAsync(uint16_t x0, uint16_t x1, uint16_t y, uint16_t color)
 {
   // Allows for slightly better performance than setting individual pixels
 
@@ -260,15 +346,15 @@ void lcdDrawHLine(uint16_t x0, uint16_t x1, uint16_t y, uint16_t color)
 		x0 = lcdProperties.width - 1;
 	}
 
-	lcdSetWindow(x0, y, x1, y);
-
-	for (int line = x0; line <= x1; line++)
-	{
-		lcdWriteData(color);
-	}
+	return lcdQueueFill(x0, y, x1 - x0 + 1, 1, color);
 }
 
 void lcdDrawVLine(uint16_t x, uint16_t y0, uint16_t y1, uint16_t color)
+{
+  lcdFenceWait(lcdDrawVLineAsync(x, y0, y1, color));
+}
+
+uint32_t lcdDrawVLineAsync(uint16_t x, uint16_t y0, uint16_t y1, uint16_t color)
 {
   if (y1 < y0)
   {
@@ -290,12 +376,7 @@ void lcdDrawVLine(uint16_t x, uint16_t y0, uint16_t y1, uint16_t color)
     y1 = lcdProperties.height - 1;
   }
 
-  lcdSetWindow(x, y0, x, y1);
-
-  for(int line = y0; line <= y1; line++)
-  {
-	  lcdWriteData(color);
-  }
+  return lcdQueueFill(x, y0, 1, y1 - y0 + 1, color);
 }
 
 /**
@@ -312,6 +393,19 @@ void lcdDrawVLine(uint16_t x, uint16_t y0, uint16_t y1, uint16_t color)
 void lcdDrawLine(int16_t x1, int16_t y1, int16_t x2, int16_t y2, uint16_t color)
 {
 	// Bresenham's algorithm - thx wikpedia
+	// pixels sharing a row (a column when steep) go out as one run
+
+	if (y1 == y2)
+	{
+		lcdDrawRun(x1, x2, y1, false, color);
+		return;
+	}
+
+	if (x1 == x2)
+	{
+		lcdDrawRun(y1, y2, x1, true, color);
+		return;
+	}
 
 	int16_t steep = abs(y2 - y1) > abs(x2 - x1);
 	if (steep)
@@ -342,17 +436,16 @@ void lcdDrawLine(int16_t x1, int16_t y1, int16_t x2, int16_t y2, uint16_t color)
 		ystep = -1;
 	}
 
+	int16_t start = x1;
+
 	for (; x1 <= x2; x1++)
 	{
-		if (steep)
-		{
-			lcdDrawPixel(y1, x1, color);
-		}
-		else
+		err -= dy;
+		if ((err < 0) || (x1 == x2))
 		{
-			lcdDrawPixel(x1, y1, color);
+			lcdDrawRun(start, x1, y1, steep, color);
+			start = x1 + 1;
 		}
-		err -= dy;
 		if (err < 0)
 		{
 			y1 += ystep;
@@ -537,7 +630,7 @@ void lcdDrawTriangle(int16_t x0, int16_t y0, int16_t x1, int16_t y1, int16_t x2,
  */
 void lcdFillCircle(int16_t x0, int16_t y0, int16_t r, uint16_t color)
 {
-	lcdDrawVLine(x0, y0 - r, y0 + r + 1, color);
+	lcdDrawVLine(x0, y0 - r, y0 + r, color);
 	lcdFillCircleHelper(x0, y0, r, 3, 0, color);
 }
 
@@ -575,13 +668,13 @@ void lcdFillCircleHelper(int16_t x0, int16_t y0, int16_t r, uint8_t cornername,
 
 		if (cornername & 0x1)
 		{
-			lcdDrawVLine(x0 + x, y0 - y, y0 + y + 1 + delta, color);
-			lcdDrawVLine(x0 + y, y0 - x, y0 + x + 1 + delta, color);
+			lcdDrawVLine(x0 + x, y0 - y, y0 + y + delta, color);
+			lcdDrawVLine(x0 + y, y0 - x, y0 + x + delta, color);
 		}
 		if (cornername & 0x2)
 		{
-			lcdDrawVLine(x0 - x, y0 - y, y0 + y + 1 + delta, color);
-			lcdDrawVLine(x0 - y, y0 - x, y0 + x + 1 + delta, color);
+			lcdDrawVLine(x0 - x, y0 - y, y0 + y + delta, color);
+			lcdDrawVLine(x0 - y, y0 - x, y0 + x + delta, color);
 		}
 	}
 }
@@ -599,15 +692,61 @@ void lcdFillCircleHelper(int16_t x0, int16_t y0, int16_t r, uint8_t cornername,
  */
 void lcdFillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t fillcolor)
 {
-	// clipping
-	if((x >= lcdProperties.width) || (y >= lcdProperties.height)) return;
-	if((x + w - 1) >= lcdProperties.width) w = lcdProperties.width - x;
-	if((y + h - 1) >= lcdProperties.height) h = lcdProperties.height - y;
+	lcdFenceWait(lcdFillRectAsync(x, y, w, h, fillcolor));
+}
 
-	for(int16_t y1 = y; y1 <= y + h; y1++)
+/**
+ * \brief Queues a rectangle fill, large fills run on DMA2
+ *
+ * \param x				The x-coordinate of the upper-left corner of the rectangle to draw
+ * \param y				The y-coordinate of the upper-left corner of the rectangle to draw
+ * \param w				Width of the rectangle to draw
+ * \param h				Height of the rectangle to draw
+ * \param fillcolor		Color
+ *
+ * \return Fence to pass to lcdFenceDone/lcdFenceWait
+ */
+uint32_t lcdFillRectAsync(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t fillcolor)
+{
+	// clipping
+	if((x < lcdProperties.width) && (y < lcdProperties.height))
 	{
-		lcdDrawHLine(x, x + w, y1, fillcolor);
+		if(x < 0) { w += x; x = 0; }
+		if(y < 0) { h += y; y = 0; }
+		if((x + w - 1) >= lcdProperties.width) w = lcdProperties.width - x;
+		if((y + h - 1) >= lcdProperties.height) h = lcdProperties.height - y;
 	}
+	else
+		w = 0;
+
+	// one window for the whole rectangle, the controller wraps rows by itself
+	return lcdQueueFill(x, y, w, h, fillcolor);
+}
+
+/**
+ * \brief Tells whether the command that returned this fence, and every command before it, has finished
+ *
+ * \param fence	Value returned by an lcd*Async call
+ *
+ * \return true when the pixels are in GRAM
+ */
+bool lcdFenceDone(uint32_t fence)
+{
+	return (int32_t)(lcdFenceCompleted - fence) >= 0;
+}
+
+/**
+ * \brief Waits until lcdFenceDone(fence), thread mode only. A queued blit waits for a flash job
+ *        that holds the bus, so a wait can last as long as that job.
+ *
+ * \param fence	Value returned by an lcd*Async call
+ *
+ * \return void
+ */
+void lcdFenceWait(uint32_t fence)
+{
+	while (!lcdFenceDone(fence))
+		lcdQueueKick();
 }
 
 /**
@@ -740,6 +879,44 @@ void lcdDrawImage(uint16_t x, uint16_t y, GUI_CONST_STORAGE GUI_BITMAP* pBitmap)
 	}
 }
 
+/**
+ * \brief Copies a w x h RGB565 image stored big endian in the SPI flash straight into GRAM
+ *
+ * \param x				The x-coordinate of the upper-left corner of the image
+ * \param y				The y-coordinate of the upper-left corner of the image
+ * \param w				Width of the image
+ * \param h				Height of the image
+ * \param flash_addr	Byte address of the first pixel in the W25Qxx
+ *
+ * \return void
+ */
+void lcdBlitFromFlash(uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint32_t flash_addr)
+{
+	lcdFenceWait(lcdBlitFromFlashAsync(x, y, w, h, flash_addr));
+}
+
+uint32_t lcdBlitFromFlashAsync(uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint32_t flash_addr)
+{
+	lcdCmdTypeDef cmd = { LCD_CMD_BLIT };
+
+	cmd.x = x;
+	cmd.y = y;
+	cmd.w = w;
+	cmd.h = h;
+	cmd.addr = flash_addr;
+	return lcdQueueSubmit(&cmd);
+}
+
+static void lcdDoBlitFromFlash(uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint32_t flash_addr)
+{
+	if((x >= lcdProperties.width) || (y >= lcdProperties.height)) return;
+	if((x + w - 1) >= lcdProperties.width) return;
+	if((y + h - 1) >= lcdProperties.height) return;
+
+	lcdSetWindow(x, y, x + w - 1, y + h - 1);
+	W25qxx_ReadStreamToPort(flash_addr, LCD_DataPort, (uint32_t)w * h);
+}
+
 void lcdHome(void)
 {
 	cursorXY.x = 0;
@@ -760,41 +937,77 @@ void lcdHome(void)
  * \return void
  */
 void lcdDrawChar(int16_t x, int16_t y, unsigned char c, uint16_t color, uint16_t bg)
+{
+	lcdFenceWait(lcdDrawCharAsync(x, y, c, color, bg));
+}
+
+uint32_t lcdDrawCharAsync(int16_t x, int16_t y, unsigned char c, uint16_t color, uint16_t bg)
+{
+	lcdCmdTypeDef cmd = { LCD_CMD_CHAR };
+
+	cmd.x = x;
+	cmd.y = y;
+	cmd.c = c;
+	cmd.color = color;
+	cmd.bg = bg;
+	cmd.font = lcdFont.pFont;
+	return lcdQueueSubmit(&cmd);
+}
+
+static void lcdDoDrawChar(int16_t x, int16_t y, unsigned char c, uint16_t color, uint16_t bg, sFONT *font)
 {
 	if ((x >= lcdProperties.width) || 			// Clip right
 			(y >= lcdProperties.height) || 		// Clip bottom
-			((x + lcdFont.pFont->Width) < 0) || // Clip left
-			((y + lcdFont.pFont->Height) < 0))  // Clip top
+			((x + font->Width) <= 0) || 			// Clip left
+			((y + font->Height) <= 0))  			// Clip top
 		return;
 
-	uint8_t fontCoeff = lcdFont.pFont->Height / 8;
-	uint8_t xP = 0;
+	uint8_t bytesPerRow = (font->Width + 7) / 8;
+	const uint8_t *glyph = &font->table[(c - 0x20) * font->Height * bytesPerRow];
+	uint32_t top = 1UL << (bytesPerRow * 8 - 1);
+	uint32_t bits;
+
+	// visible part of the glyph cell, in cell coordinates
+	int16_t i0 = (y < 0) ? -y : 0;
+	int16_t i1 = (y + font->Height > lcdProperties.height) ? lcdProperties.height - y : font->Height;
+	int16_t j0 = (x < 0) ? -x : 0;
+	int16_t j1 = (x + font->Width > lcdProperties.width) ? lcdProperties.width - x : font->Width;
 
-	for(uint8_t i = 0; i < lcdFont.pFont->Height; i++)
+	if (bg != color)
 	{
-		uint8_t line;
+		// opaque: one window for the cell, the bitmap is streamed row by row
+		lcdSetWindow(x + j0, y + i0, x + j1 - 1, y + i1 - 1);
 
-		for(uint8_t k = 0; k < fontCoeff; k++)
+		for (int16_t i = i0; i < i1; i++)
 		{
-			line = lcdFont.pFont->table[((c - 0x20) * lcdFont.pFont->Height * fontCoeff) + (i * fontCoeff) + k];
-
-			for(uint8_t j = 0; j < 8; j++)
-			{
-				if((line & 0x80) == 0x80)
-				{
-					lcdDrawPixel(x + j + xP, y + i, color);
-				}
-				else if (bg != color)
-				{
-					lcdDrawPixel(x + j + xP, y + i, bg);
-				}
-				line <<= 1;
-			}
+			bits = 0;
+			for (uint8_t k = 0; k < bytesPerRow; k++)
+				bits = (bits << 8) | glyph[i * bytesPerRow + k];
 
-			xP += 8;
+			for (int16_t j = j0; j < j1; j++)
+				lcdWriteData((bits & (top >> j)) ? color : bg);
 		}
+		return;
+	}
+
+	// transparent: each horizontal run of set pixels becomes one line
+	for (int16_t i = i0; i < i1; i++)
+	{
+		bits = 0;
+		for (uint8_t k = 0; k < bytesPerRow; k++)
+			bits = (bits << 8) | glyph[i * bytesPerRow + k];
 
-		xP = 0;
+		for (int16_t j = j0; j < j1; j++)
+		{
+			if ((bits & (top >> j)) == 0)
+				continue;
+
+			int16_t start = j;
+			while ((j + 1 < j1) && (bits & (top >> (j + 1))))
+				j++;
+			lcdSetWindow(x + start, y + i, x + j, y + i);
+			lcdWriteColor(color, j - start + 1);
+		}
 	}
 }
 
@@ -811,6 +1024,7 @@ void lcdPrintf(const char *fmt, ...)
 	static char buf[256];
 	char *p;
 	va_list lst;
+	uint32_t fence = lcdFenceIssued;
 
 	va_start(lst, fmt);
 	vsprintf(buf, fmt, lst);
@@ -834,7 +1048,7 @@ void lcdPrintf(const char *fmt, ...)
 		}
 		else
 		{
-			lcdDrawChar(cursorXY.x, cursorXY.y, *p, lcdFont.TextColor, lcdFont.BackColor);
+			fence = lcdDrawCharAsync(cursorXY.x, cursorXY.y, *p, lcdFont.TextColor, lcdFont.BackColor);
 			cursorXY.x += lcdFont.pFont->Width;
 			if (lcdFont.TextWrap && (cursorXY.x > (lcdProperties.width - lcdFont.pFont->Width)))
 			{
@@ -849,6 +1063,8 @@ void lcdPrintf(const char *fmt, ...)
 			cursorXY.y = 0;
 		}
 	}
+	// the chars go out back to back, only the last one is waited for
+	lcdFenceWait(fence);
 }
 
 /**
@@ -891,33 +1107,46 @@ void lcdSetTextWrap(uint8_t w)
 
 void lcdSetOrientation(lcdOrientationTypeDef value)
 {
+	unsigned char config;
+
+	lcdBusAcquire();		// queued commands were clipped against the old size
 	lcdProperties.orientation = value;
-	lcdWriteCommand(ILI9341_MEMCONTROL);
 
 	switch (lcdProperties.orientation)
 	{
 		case LCD_ORIENTATION_PORTRAIT:
-			lcdWriteData(lcdPortraitConfig);
+			config = lcdPortraitConfig;
 			lcdProperties.width = ILI9341_PIXEL_WIDTH;
 			lcdProperties.height = ILI9341_PIXEL_HEIGHT;
 			break;
 		case LCD_ORIENTATION_PORTRAIT_MIRROR:
-			lcdWriteData(lcdPortraitMirrorConfig);
+			config = lcdPortraitMirrorConfig;
 			lcdProperties.width = ILI9341_PIXEL_WIDTH;
 			lcdProperties.height = ILI9341_PIXEL_HEIGHT;
 			break;
 		case LCD_ORIENTATION_LANDSCAPE:
-			lcdWriteData(lcdLandscapeConfig);
+			config = lcdLandscapeConfig;
 			lcdProperties.width = ILI9341_PIXEL_HEIGHT;
 			lcdProperties.height = ILI9341_PIXEL_WIDTH;
 			break;
 		case LCD_ORIENTATION_LANDSCAPE_MIRROR:
-			lcdWriteData(lcdLandscapeMirrorConfig);
+			config = lcdLandscapeMirrorConfig;
 			lcdProperties.width = ILI9341_PIXEL_HEIGHT;
 			lcdProperties.height = ILI9341_PIXEL_WIDTH;
 			break;
 		default:
-			break;
+			return;
+	}
+
+	if (config != lcdShadowMadctl)
+	{
+		lcdWriteCommand(ILI9341_MEMCONTROL);
+		lcdWriteData(config);
+		lcdShadowMadctl = config;
+	}
+	else
+	{
+		lcdBusStats.savedWrites += 2;
 	}
 
 	//lcdWriteCommand(ILI9341_MEMORYWRITE);
@@ -943,19 +1172,121 @@ void lcdSetCursor(unsigned short x, unsigned short y)
  */
 void lcdSetWindow(unsigned short x0, unsigned short y0, unsigned short x1, unsigned short y1)
 {
-  lcdWriteCommand(ILI9341_COLADDRSET);
-  lcdWriteData((x0 >> 8) & 0xFF);
-  lcdWriteData(x0 & 0xFF);
-  lcdWriteData((x1 >> 8) & 0xFF);
-  lcdWriteData(x1 & 0xFF);
-  lcdWriteCommand(ILI9341_PAGEADDRSET);
-  lcdWriteData((y0 >> 8) & 0xFF);
-  lcdWriteData(y0 & 0xFF);
-  lcdWriteData((y1 >> 8) & 0xFF);
-  lcdWriteData(y1 & 0xFF);
+  lcdSetAddress(x0, y0, x1, y1);
+  // RAMWR always goes out, it restarts the write pointer at (x0, y0)
   lcdWriteCommand(ILI9341_MEMORYWRITE);
 }
 
+/**
+ * \brief Bus writes avoided by the CASET/PASET/MADCTL shadow since the last reset of the counters
+ *
+ * \param reset	Clear the counters after reading them
+ *
+ * \return lcdBusStatsTypeDef
+ */
+lcdBusStatsTypeDef lcdGetBusStats(bool reset)
+{
+  lcdBusStatsTypeDef stats = lcdBusStats;
+  if (reset)
+  {
+    lcdBusStats.windowCalls = 0;
+    lcdBusStats.savedWrites = 0;
+  }
+  return stats;
+}
+
+/**
+ * \brief Steps the FSMC write and read timings down while test patterns still read back from GRAM,
+ *        then programs the fastest passing values plus a margin. Call once after LCD_ILI9341_init,
+ *        before drawing: the patterns go to the top left corner and the fill rate is measured
+ *        with a full screen of black, so the screen is black afterwards.
+ *
+ * \param margin	HCLK cycles added to the fastest passing DATAST of each direction
+ *
+ * \return The timings in use afterwards
+ */
+lcdBusTimingTypeDef lcdTuneBusTiming(uint8_t margin)
+{
+  lcdBusTimingTypeDef safe, test;
+  uint32_t count, cycles;
+
+  lcdBusAcquire();
+
+  // start from what MX_FSMC_Init programmed
+  safe.writeAddSet = READ_BIT(hsram1.Extended->BWTR[FSMC_NORSRAM_BANK4], FSMC_BWTRx_ADDSET_Msk) >> FSMC_BWTRx_ADDSET_Pos;
+  safe.writeDataSet = READ_BIT(hsram1.Extended->BWTR[FSMC_NORSRAM_BANK4], FSMC_BWTRx_DATAST_Msk) >> FSMC_BWTRx_DATAST_Pos;
+  safe.readAddSet = READ_BIT(hsram1.Instance->BTCR[FSMC_NORSRAM_BANK4 + 1], FSMC_BTRx_ADDSET_Msk) >> FSMC_BTRx_ADDSET_Pos;
+  safe.readDataSet = READ_BIT(hsram1.Instance->BTCR[FSMC_NORSRAM_BANK4 + 1], FSMC_BTRx_DATAST_Msk) >> FSMC_BTRx_DATAST_Pos;
+  safe.pixelsPerSecond = 0;
+  safe.verified = lcdTuneCheck(&safe, &safe);
+  test = safe;
+
+  if (test.verified)
+  {
+    // reads first, checked against writes at the stock timing
+    lcdTuneLower(&test.readDataSet, 1, &test, &safe);
+    lcdTuneLower(&test.readAddSet, 0, &test, &safe);
+    test.readDataSet = (test.readDataSet + margin > 255) ? 255 : test.readDataSet + margin;
+    safe.readAddSet = test.readAddSet;
+    safe.readDataSet = test.readDataSet;
+
+    // then writes, read back with the timing just chosen
+    lcdTuneLower(&test.writeDataSet, 1, &test, &safe);
+    lcdTuneLower(&test.writeAddSet, 0, &test, &safe);
+    test.writeDataSet = (test.writeDataSet + margin > 255) ? 255 : test.writeDataSet + margin;
+  }
+  lcdTuneSetWrite(test.writeAddSet, test.writeDataSet);
+  lcdTuneSetRead(test.readAddSet, test.readDataSet);
+
+  // fill rate with the final write timing
+  count = (uint32_t)lcdProperties.width * lcdProperties.height;
+  lcdSetWindow(0, 0, lcdProperties.width - 1, lcdProperties.height - 1);
+  cycles = DWT->CYCCNT;
+  lcdWriteColor(COLOR_BLACK, count);
+  cycles = DWT->CYCCNT - cycles;
+  test.pixelsPerSecond = cycles ? (uint32_t)(((uint64_t)count * SystemCoreClock) / cycles) : 0;
+
+  lcdBusTiming = test;
+  return test;
+}
+
+/**
+ * \brief Timings from the last lcdTuneBusTiming, all zero before it ran
+ *
+ * \param
+ *
+ * \return lcdBusTimingTypeDef
+ */
+lcdBusTimingTypeDef lcdGetBusTiming(void)
+{
+  return lcdBusTiming;
+}
+
+/**
+ * \brief Work done by the render queue back end since the last reset of the counters
+ *
+ * \param reset	Clear the counters after reading them
+ *
+ * \return lcdQueueStatsTypeDef
+ */
+lcdQueueStatsTypeDef lcdGetQueueStats(bool reset)
+{
+  lcdQueueStatsTypeDef stats;
+  uint32_t primask;
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  stats = lcdQueueStats;
+  if (reset)
+  {
+    lcdQueueStats.commands = 0;
+    lcdQueueStats.pixels = 0;
+    lcdQueueStats.cpuCycles = 0;
+  }
+  __set_PRIMASK(primask);
+  return stats;
+}
+
 void lcdBacklightOff(void)
 {
 	LCD_BL_OFF();
@@ -1050,14 +1381,7 @@ uint16_t lcdReadPixel(uint16_t x, uint16_t y)
     if ((x < 0) || (y < 0) || (x >= lcdProperties.width) || (y >= lcdProperties.height))
         return 0;
 
-    lcdWriteCommand(ILI9341_COLADDRSET);
-    lcdWriteData((x >> 8) & 0xFF);
-    lcdWriteData(x & 0xFF);
-
-    lcdWriteCommand(ILI9341_PAGEADDRSET);
-    lcdWriteData((y >> 8) & 0xFF);
-    lcdWriteData(y & 0xFF);
-
+    lcdSetAddress(x, y, x, y);
     lcdWriteCommand(ILI9341_MEMORYREAD);
 
     temp[0] = lcdReadData(); // dummy read
@@ -1087,24 +1411,515 @@ static void lcdDrawPixels(uint16_t x, uint16_t y, uint16_t *data, uint32_t dataL
   while (i < dataLength);
 }
 
+// Clipped run from a0 to a1 on row b (column b when vertical), drawn by the HLine/VLine burst writers
+static void lcdDrawRun(int16_t a0, int16_t a1, int16_t b, bool vertical, uint16_t color)
+{
+	int16_t aMax = (vertical ? lcdProperties.height : lcdProperties.width) - 1;
+	int16_t bMax = (vertical ? lcdProperties.width : lcdProperties.height) - 1;
+
+	if (a0 > a1)
+	{
+		swap(a0, a1);
+	}
+
+	if ((b < 0) || (b > bMax) || (a1 < 0) || (a0 > aMax))
+		return;
+
+	if (a0 < 0)
+		a0 = 0;
+	if (a1 > aMax)
+		a1 = aMax;
+
+	if (vertical)
+		lcdDrawVLine(b, a0, a1, color);
+	else
+		lcdDrawHLine(a0, a1, b, color);
+}
+
 static void lcdReset(void)
 {
 	lcdWriteCommand(ILI9341_SOFTRESET);
 	HAL_Delay(50);
+	lcdShadowX0 = lcdShadowX1 = lcdShadowY0 = lcdShadowY1 = 0xFFFF;
+	lcdShadowMadctl = 0xFFFF;
+}
+
+// CASET/PASET, each sent only when it differs from what the controller already holds
+static void lcdSetAddress(unsigned short x0, unsigned short y0, unsigned short x1, unsigned short y1)
+{
+  lcdBusAcquire();		// before the shadow is trusted
+  lcdBusStats.windowCalls++;
+  if ((x0 != lcdShadowX0) || (x1 != lcdShadowX1))
+  {
+    lcdWriteCommand(ILI9341_COLADDRSET);
+    lcdWriteData((x0 >> 8) & 0xFF);
+    lcdWriteData(x0 & 0xFF);
+    lcdWriteData((x1 >> 8) & 0xFF);
+    lcdWriteData(x1 & 0xFF);
+    lcdShadowX0 = x0;
+    lcdShadowX1 = x1;
+  }
+  else
+  {
+    lcdBusStats.savedWrites += 5;
+  }
+  if ((y0 != lcdShadowY0) || (y1 != lcdShadowY1))
+  {
+    lcdWriteCommand(ILI9341_PAGEADDRSET);
+    lcdWriteData((y0 >> 8) & 0xFF);
+    lcdWriteData(y0 & 0xFF);
+    lcdWriteData((y1 >> 8) & 0xFF);
+    lcdWriteData(y1 & 0xFF);
+    lcdShadowY0 = y0;
+    lcdShadowY1 = y1;
+  }
+  else
+  {
+    lcdBusStats.savedWrites += 5;
+  }
+}
+
+// BWTR4, the write timing. Pending FSMC writes finish first so no cycle runs with a half updated setting.
+static void lcdTuneSetWrite(uint8_t addSet, uint8_t dataSet)
+{
+	__DSB();
+	MODIFY_REG(hsram1.Extended->BWTR[FSMC_NORSRAM_BANK4], FSMC_BWTRx_ADDSET_Msk | FSMC_BWTRx_DATAST_Msk,
+			((uint32_t)addSet << FSMC_BWTRx_ADDSET_Pos) | ((uint32_t)dataSet << FSMC_BWTRx_DATAST_Pos));
+	__DSB();
+}
+
+// BTR4, the read timing
+static void lcdTuneSetRead(uint8_t addSet, uint8_t dataSet)
+{
+	__DSB();
+	MODIFY_REG(hsram1.Instance->BTCR[FSMC_NORSRAM_BANK4 + 1], FSMC_BTRx_ADDSET_Msk | FSMC_BTRx_DATAST_Msk,
+			((uint32_t)addSet << FSMC_BTRx_ADDSET_Pos) | ((uint32_t)dataSet << FSMC_BTRx_DATAST_Pos));
+	__DSB();
+}
+
+// Test pixel i of pattern p. R and B stay equal, so the compare does not depend on the MADCTL BGR bit.
+static uint16_t lcdTunePixel(uint8_t p, uint32_t i)
+{
+	uint32_t v;
+
+	switch (p)
+	{
+	case 0:
+		return (i & 1) ? 0xFFFF : 0x0000;	// every data line toggles
+	case 1:
+		return (i & 1) ? 0x07E0 : 0xF81F;	// upper/lower halves swap
+	default:
+		v = (i + 1) * 2654435761u;			// scrambled
+		return ((v >> 27) << 11) | (((v >> 10) & 0x3F) << 5) | (v >> 27);
+	}
+}
+
+// Streams the patterns into the test window with the write timing under test and reads them back
+// through RAMRD with the read timing under test. Commands always go out with the safe write timing.
+static bool lcdTuneCheck(const lcdBusTimingTypeDef *test, const lcdBusTimingTypeDef *safe)
+{
+	uint16_t word[3];
+	bool ok = true;
+
+	for (uint8_t p = 0; (p < 3) && ok; p++)
+	{
+		lcdTuneSetWrite(safe->writeAddSet, safe->writeDataSet);
+		lcdSetWindow(0, 0, LCD_TUNE_W - 1, LCD_TUNE_H - 1);
+		lcdTuneSetWrite(test->writeAddSet, test->writeDataSet);
+		for (uint32_t i = 0; i < LCD_TUNE_W * LCD_TUNE_H; i++)
+			lcdWriteData(lcdTunePixel(p, i));
+		lcdTuneSetWrite(safe->writeAddSet, safe->writeDataSet);
+
+		// RAMRD starts over at the window origin, 18 bit pixels come as R G B bytes, two pixels per three words
+		lcdWriteCommand(ILI9341_MEMORYREAD);
+		lcdTuneSetRead(test->readAddSet, test->readDataSet);
+		(void)lcdReadData();	// dummy read
+		for (uint32_t i = 0; i < LCD_TUNE_W * LCD_TUNE_H; i += 2)
+		{
+			word[0] = lcdReadData();
+			word[1] = lcdReadData();
+			word[2] = lcdReadData();
+			if ((lcdColor565(word[0] >> 8, word[0] & 0xFF, word[1] >> 8) != lcdTunePixel(p, i)) ||
+				(lcdColor565(word[1] & 0xFF, word[2] >> 8, word[2] & 0xFF) != lcdTunePixel(p, i + 1)))
+				ok = false;
+		}
+		lcdTuneSetRead(safe->readAddSet, safe->readDataSet);
+	}
+	return ok;
+}
+
+// Lowers *field one cycle at a time while lcdTuneCheck passes, leaves it at the last passing value
+static void lcdTuneLower(uint8_t *field, uint8_t min, lcdBusTimingTypeDef *test, const lcdBusTimingTypeDef *safe)
+{
+	while (*field > min)
+	{
+		(*field)--;
+		if (!lcdTuneCheck(test, safe))
+		{
+			(*field)++;
+			return;
+		}
+	}
+}
+
+#if (LCD_TRACE_WORDS > 0)
+static uint16_t lcdTraceBuf[LCD_TRACE_WORDS];
+static uint32_t lcdTraceLen;
+static uint32_t lcdTraceLiteral;	// index of the open 0xC000 token, LCD_TRACE_WORDS = none
+static uint16_t lcdTraceRunWord;
+static uint16_t lcdTraceRunLen;
+static uint16_t lcdTraceFrameNo;
+static bool lcdTraceOn = false;
+
+static void lcdTraceEmit(uint16_t token, uint16_t word, uint8_t count)
+{
+	if (lcdTraceLen + count > LCD_TRACE_WORDS)
+	{
+		lcdTraceOn = false;		// full: keep what fits, the caller sees the shorter length
+		return;
+	}
+	lcdTraceBuf[lcdTraceLen++] = token;
+	if (count == 2)
+		lcdTraceBuf[lcdTraceLen++] = word;
+}
+
+static void lcdTraceFlush(void)
+{
+	if (lcdTraceRunLen >= 2)
+	{
+		lcdTraceEmit(0x4000 | lcdTraceRunLen, lcdTraceRunWord, 2);
+		lcdTraceLiteral = LCD_TRACE_WORDS;
+	}
+	else if (lcdTraceRunLen == 1)
+	{
+		if ((lcdTraceLiteral < LCD_TRACE_WORDS) && ((lcdTraceBuf[lcdTraceLiteral] & 0x3FFF) < 0x3FFF))
+		{
+			lcdTraceEmit(lcdTraceRunWord, 0, 1);
+			if (lcdTraceOn)
+				lcdTraceBuf[lcdTraceLiteral]++;
+		}
+		else
+		{
+			lcdTraceLiteral = lcdTraceLen;
+			lcdTraceEmit(0xC001, lcdTraceRunWord, 2);
+		}
+	}
+	lcdTraceRunLen = 0;
+}
+
+static void lcdTraceCommand(uint16_t token)
+{
+	lcdTraceFlush();
+	lcdTraceEmit(token, 0, 1);
+	lcdTraceLiteral = LCD_TRACE_WORDS;
+}
+
+static void lcdTraceData(uint16_t data)
+{
+	if ((lcdTraceRunLen > 0) && (data == lcdTraceRunWord) && (lcdTraceRunLen < 0x3FFF))
+	{
+		lcdTraceRunLen++;
+		return;
+	}
+	lcdTraceFlush();
+	lcdTraceRunWord = data;
+	lcdTraceRunLen = 1;
+}
+#endif
+
+/**
+ * \brief Starts recording bus traffic into the trace buffer, dropping any previous trace.
+ *        The trace opens with MADCTL and the next window is sent in full, so it replays from reset.
+ *
+ * \param
+ *
+ * \return void
+ */
+void lcdTraceStart(void)
+{
+#if (LCD_TRACE_WORDS > 0)
+	lcdTraceLen = 0;
+	lcdTraceLiteral = LCD_TRACE_WORDS;
+	lcdTraceRunLen = 0;
+	lcdTraceFrameNo = 0;
+	lcdTraceOn = true;
+
+	if (lcdShadowMadctl != 0xFFFF)
+	{
+		lcdWriteCommand(ILI9341_MEMCONTROL);
+		lcdWriteData(lcdShadowMadctl);
+	}
+	lcdShadowX0 = lcdShadowX1 = lcdShadowY0 = lcdShadowY1 = 0xFFFF;
+#endif
+}
+
+/**
+ * \brief Marks the end of a frame in the trace, so per-frame overhead can be told apart
+ *
+ * \param
+ *
+ * \return void
+ */
+void lcdTraceFrame(void)
+{
+#if (LCD_TRACE_WORDS > 0)
+	if (lcdTraceOn)
+		lcdTraceCommand(0x8000 | (lcdTraceFrameNo++ & 0x3FFF));
+#endif
+}
+
+/**
+ * \brief Stops recording
+ *
+ * \param words	Receives the trace length in 16 bit words
+ *
+ * \return The trace buffer, NULL when the recorder is compiled out
+ */
+const uint16_t* lcdTraceStop(uint32_t *words)
+{
+#if (LCD_TRACE_WORDS > 0)
+	if (lcdTraceOn)
+		lcdTraceFlush();
+	lcdTraceOn = false;
+	*words = lcdTraceLen;
+	return lcdTraceBuf;
+#else
+	*words = 0;
+	return NULL;
+#endif
 }
 
 // Write an 8 bit command to the IC driver
 static void lcdWriteCommand(unsigned char command)
 {
+	lcdBusAcquire();		// every new window starts with a command, so nothing interleaves with queued work
+#if (LCD_TRACE_WORDS > 0)
+	if (lcdTraceOn)
+		lcdTraceCommand(command);
+#endif
 	LCD_CmdWrite(command);
 }
 
 // Write an 16 bit data word to the IC driver
 static void lcdWriteData(unsigned short data)
 {
+#if (LCD_TRACE_WORDS > 0)
+	if (lcdTraceOn)
+		lcdTraceData(data);
+#endif
 	LCD_DataWrite(data);
 }
 
+// Stream the same color count times into the open window, 16 pixels per loop
+static void lcdWriteColor(uint16_t color, uint32_t count)
+{
+#if (LCD_TRACE_WORDS > 0)
+	if (lcdTraceOn)
+	{
+		while (count--)
+			lcdWriteData(color);
+		return;
+	}
+#endif
+#ifdef LCD_DataWrite32
+	uint32_t pair = ((uint32_t)color << 16) | color;
+
+	for (; count >= 16; count -= 16)
+	{
+		LCD_DataWrite32(pair); LCD_DataWrite32(pair); LCD_DataWrite32(pair); LCD_DataWrite32(pair);
+		LCD_DataWrite32(pair); LCD_DataWrite32(pair); LCD_DataWrite32(pair); LCD_DataWrite32(pair);
+	}
+	for (; count >= 2; count -= 2)
+		LCD_DataWrite32(pair);
+#else
+	for (; count >= 16; count -= 16)
+	{
+		LCD_DataWrite(color); LCD_DataWrite(color); LCD_DataWrite(color); LCD_DataWrite(color);
+		LCD_DataWrite(color); LCD_DataWrite(color); LCD_DataWrite(color); LCD_DataWrite(color);
+		LCD_DataWrite(color); LCD_DataWrite(color); LCD_DataWrite(color); LCD_DataWrite(color);
+		LCD_DataWrite(color); LCD_DataWrite(color); LCD_DataWrite(color); LCD_DataWrite(color);
+	}
+#endif
+	while (count--)
+		LCD_DataWrite(color);
+}
+
+#if LCD_DMA_FILL
+static void lcdDmaFillCplt(DMA_HandleTypeDef *hdma);
+
+// Hands the next chunk to DMA2, the transfer counter is 16 bit
+static void lcdDmaFillNext(void)
+{
+	uint32_t n = (lcdDmaLeft > 0xFFFF) ? 0xFFFF : lcdDmaLeft;
+
+	lcdDmaLeft -= n;
+	if (HAL_DMA_Start_IT(&hdma_memtomem_dma2_channel1, (uint32_t)&lcdDmaColor, LCD_BASE1, n) != HAL_OK)
+	{
+		// channel refused, nobody else may touch the bus until lcdDmaBusy drops: finish on the CPU
+		lcdWriteColor(lcdDmaColor, n + lcdDmaLeft);
+		lcdDmaLeft = 0;
+		lcdDmaFillCplt(&hdma_memtomem_dma2_channel1);
+	}
+}
+
+// DMA2 channel 1 transfer complete or error, from DMA2_Channel1_IRQHandler
+static void lcdDmaFillCplt(DMA_HandleTypeDef *hdma)
+{
+	if (lcdDmaLeft && (hdma->ErrorCode == HAL_DMA_ERROR_NONE))
+	{
+		lcdDmaFillNext();
+		return;
+	}
+	lcdDmaLeft = 0;
+	lcdFenceCompleted = lcdDmaFence;
+	lcdDmaBusy = false;
+	lcdQueueKick();
+}
+#endif
+
+// Fills count pixels of the open window, in the background when it is large enough for DMA.
+// The fence completes right away for CPU fills.
+static void lcdFillStart(uint16_t color, uint32_t count, uint32_t fence)
+{
+#if LCD_DMA_FILL
+	bool dma = (count >= LCD_DMA_FILL_MIN);
+#if (LCD_TRACE_WORDS > 0)
+	if (lcdTraceOn)
+		dma = false;		// keep every word visible to the recorder
+#endif
+	lcdFillWait();		// fences complete in order, even for an empty fill
+	if (dma)
+	{
+		lcdDmaColor = color;
+		lcdDmaLeft = count;
+		lcdDmaFence = fence;
+		lcdDmaBusy = true;
+		hdma_memtomem_dma2_channel1.XferCpltCallback = lcdDmaFillCplt;
+		hdma_memtomem_dma2_channel1.XferHalfCpltCallback = NULL;
+		hdma_memtomem_dma2_channel1.XferErrorCallback = lcdDmaFillCplt;
+		lcdDmaFillNext();
+		return;
+	}
+#endif
+	lcdWriteColor(color, count);
+	lcdFenceCompleted = fence;
+}
+
+static bool lcdFillBusy(void)
+{
+#if LCD_DMA_FILL
+	return lcdDmaBusy;
+#else
+	return false;
+#endif
+}
+
+// Blocks until a background fill has left the bus
+static void lcdFillWait(void)
+{
+	while (lcdFillBusy()) {}
+}
+
+// Direct bus access: thread mode first lets the back end finish everything queued,
+// the back end itself only has to wait for a running DMA fill
+static void lcdBusAcquire(void)
+{
+	if (__get_IPSR() == 0)
+		lcdFenceWait(lcdFenceIssued);
+	else
+		lcdFillWait();
+}
+
+// Copies cmd into the queue, waits while it is full
+static uint32_t lcdQueueSubmit(lcdCmdTypeDef *cmd)
+{
+	while ((lcdQueueHead - lcdQueueTail) >= LCD_QUEUE_LEN)
+		lcdQueueKick();
+
+	cmd->fence = ++lcdFenceIssued;
+	lcdQueue[lcdQueueHead % LCD_QUEUE_LEN] = *cmd;
+	__DMB();
+	lcdQueueHead++;
+	lcdQueueKick();
+	return cmd->fence;
+}
+
+static uint32_t lcdQueueFill(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color)
+{
+	lcdCmdTypeDef cmd = { LCD_CMD_FILL };
+
+	cmd.x = x;
+	cmd.y = y;
+	cmd.w = w;
+	cmd.h = h;
+	cmd.color = color;
+	return lcdQueueSubmit(&cmd);
+}
+
+/**
+ * \brief Render queue back end, hooked to PendSV. Runs queued commands in order until the queue
+ *        is empty or a DMA fill owns the bus, the DMA interrupt kicks it again when the fill ends.
+ *
+ * \param
+ *
+ * \return void
+ */
+void lcdQueueProcess(void)
+{
+	uint32_t start = DWT->CYCCNT;
+	lcdCmdTypeDef *cmd;
+
+	while ((lcdQueueTail != lcdQueueHead) && !lcdFillBusy())
+	{
+		cmd = &lcdQueue[lcdQueueTail % LCD_QUEUE_LEN];
+
+		// the flash lock belongs to the main loop we preempted or to a queued job, either way PendSV must
+		// not spin in W25qxx_Lock for it: the blit waits for a kick after the owner lets go
+		if ((cmd->op == LCD_CMD_BLIT) && W25qxx_IsBusy())
+			break;
+
+		switch (cmd->op)
+		{
+		case LCD_CMD_FILL:
+			if ((cmd->w > 0) && (cmd->h > 0))
+			{
+				lcdSetWindow(cmd->x, cmd->y, cmd->x + cmd->w - 1, cmd->y + cmd->h - 1);
+				lcdFillStart(cmd->color, (uint32_t)cmd->w * cmd->h, cmd->fence);
+				lcdQueueStats.pixels += (uint32_t)cmd->w * cmd->h;
+			}
+			else
+				lcdFenceCompleted = cmd->fence;
+			break;
+		case LCD_CMD_CHAR:
+			lcdDoDrawChar(cmd->x, cmd->y, cmd->c, cmd->color, cmd->bg, cmd->font);
+			lcdQueueStats.pixels += cmd->font->Width * cmd->font->Height;
+			lcdFenceCompleted = cmd->fence;
+			break;
+		case LCD_CMD_BLIT:
+			lcdDoBlitFromFlash(cmd->x, cmd->y, cmd->w, cmd->h, cmd->addr);
+			lcdQueueStats.pixels += (uint32_t)cmd->w * cmd->h;
+			lcdFenceCompleted = cmd->fence;
+			break;
+		}
+		lcdQueueStats.commands++;
+		lcdQueueTail++;
+	}
+	lcdQueueStats.cpuCycles += DWT->CYCCNT - start;
+}
+
+/**
+ * \brief Pends the back end when commands are waiting and no DMA fill is running
+ *
+ * \param
+ *
+ * \return void
+ */
+void lcdQueueKick(void)
+{
+	if ((lcdQueueTail != lcdQueueHead) && !lcdFillBusy())
+		SCB->ICSR = SCB_ICSR_PENDSVSET_Msk;
+}
+
 static unsigned short lcdReadData(void)
 {
 	return LCD_DataRead();
@@ -18,6 +18,7 @@
 /* USER CODE END Header */
 /* Includes ------------------------------------------------------------------*/
 #include "main.h"
+#include "dma.h"
 #include "spi.h"
 #include "gpio.h"
 #include "fsmc.h"
@@ -36,6 +37,7 @@
 
 /* Private define ------------------------------------------------------------*/
 /* USER CODE BEGIN PD */
+#define PIC_SIZE (320 * 240 * 2)
 
 /* USER CODE END PD */
 
@@ -98,48 +100,97 @@ void lcd_setup_picture(uint8_t pic_nr)
 //************************************
 void readPicFromFlash(void)
 {
-	uint32_t i;
-	uint32_t page_nr, i2;
-	uint16_t rx_buff[128];
-	uint16_t* RX_ADDR  = (uint16_t*) &rx_buff[0];
-
 	lcd_setup_picture(1);
 
-	page_nr = 0;
+	lcdBlitFromFlash(0, 0, lcdGetWidth(), lcdGetHeight(), 0);
+}
+//************************************
+
+// if you want store picture into external flash you need unrem line below "#define photos"
+//#define photos
 
-	for(i = 0; i < 600; i++)
-	{
-		W25qxx_ReadPage((uint8_t*)RX_ADDR, page_nr, 0, 256);
-		page_nr ++;
+// unrem to show text rendering speed (characters per second) below the info screen
+//#define textbench
 
+#ifdef textbench
 
-		for(i2 = 0; i2 < 128 ; i2++){
-			LCD->LCD_RAM = rx_buff[i2];
+void textBench(void){
+	static const char text[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+	uint32_t start, opaque, transparent;
+	uint16_t y = lcdGetHeight() - lcdGetTextFont()->Height;
+
+	start = HAL_GetTick();
+	for (uint8_t n = 0; n < 10; n++) {
+		for (uint8_t i = 0; i < sizeof(text) - 1; i++) {
+			lcdDrawChar((i * lcdGetTextFont()->Width) % lcdGetWidth(), y, text[i], COLOR_WHITE, COLOR_BLACK);
 		}
 	}
+	opaque = HAL_GetTick() - start;
+
+	start = HAL_GetTick();
+	for (uint8_t n = 0; n < 10; n++) {
+		for (uint8_t i = 0; i < sizeof(text) - 1; i++) {
+			lcdDrawChar((i * lcdGetTextFont()->Width) % lcdGetWidth(), y, text[i], COLOR_WHITE, COLOR_WHITE);
+		}
+	}
+	transparent = HAL_GetTick() - start;
+
+	lcdPrintf("TEXT : %d / %d CHARS/S\n", (int)(10 * (sizeof(text) - 1) * 1000 / (opaque ? opaque : 1)),
+			(int)(10 * (sizeof(text) - 1) * 1000 / (transparent ? transparent : 1)));
 }
-//************************************
+#endif
 
-// if you want store picture into external flash you need unrem line below "#define photos"
-//#define photos
+// unrem to shorten the FSMC timings at boot to the fastest that still read back from GRAM. Off by
+// default: the margin is only verified against reads, writes to a marginal panel may still glitch
+//#define tunebus
 
-#ifdef photos
+// unrem to show render queue throughput and the CPU share left to the main loop while it draws
+//#define renderbench
 
-void savePicToFlash(void){
+#ifdef renderbench
 
-	uint32_t index=0;
+void renderBench(void){
+	static const uint16_t colors[] = { COLOR_RED, COLOR_GREEN, COLOR_BLUE, COLOR_BLACK };
+	lcdQueueStatsTypeDef stats;
+	uint32_t start, elapsed, fence = 0;
+	uint16_t top = lcdGetHeight() / 2;
+	uint16_t h = lcdGetHeight() - top - 2 * lcdGetTextFont()->Height;
 
+	lcdGetQueueStats(true);
+	start = HAL_GetTick();
+	for (uint8_t n = 0; n < 40; n++) {
+		fence = lcdFillRectAsync(0, top, lcdGetWidth(), h, colors[n % 4]);
+		for (uint8_t i = 0; i < 20; i++) {
+			fence = lcdDrawCharAsync(i * lcdGetTextFont()->Width, top, 'A' + i, COLOR_WHITE, colors[n % 4]);
+		}
+		// the main loop is free for other work until the fence is reached
+		while (!lcdFenceDone(fence)) {
+		}
+	}
+	elapsed = HAL_GetTick() - start;
+	stats = lcdGetQueueStats(false);
+	if (elapsed == 0) elapsed = 1;
 
+	lcdSetCursor(0, lcdGetHeight() - 2 * lcdGetTextFont()->Height);
+	lcdPrintf("RENDER : %d KPIX/S IDLE %d%%\n", (int)(stats.pixels / elapsed),
+			(int)(100 - ((uint64_t)stats.cpuCycles * 100) / ((uint64_t)elapsed * (SystemCoreClock / 1000))));
+}
+#endif
 
+#ifdef photos
 
-	W25qxx_EraseBlock(0);
-	W25qxx_EraseBlock(1);
-	W25qxx_EraseBlock(2);
+void savePicToFlash(void){
+
+	static W25qxx_Job_t program = { W25QXX_JOB_PROGRAM_PIXELS, 0, (const uint8_t*)laki, PIC_SIZE, NULL, W25QXX_PRIO_BACKGROUND };
 
+	W25qxx_EraseRange(0, PIC_SIZE, true);
+	W25qxx_JobSubmit(&program);
 
-	W25qxx_WriteBlock((uint8_t*)&laki[index], 0, 0,65536);index+=65536/2;
-	W25qxx_WriteBlock((uint8_t*)&laki[index], 1, 0,65536);index+=65536/2;
-	W25qxx_WriteBlock((uint8_t*)&laki[index], 2, 0,22528);
+	// jobs advance from SysTick, the LCD stays free for a progress bar
+	lcdDrawRect(9, 199, 302, 12, COLOR_WHITE);
+	while(!W25qxx_JobIsFinished(&program)){
+		lcdFillRect(10, 200, (300 * program.Done) / PIC_SIZE, 10, COLOR_GREEN);
+	}
 }
 
 
@@ -178,12 +229,17 @@ int main(void)
 
   /* Initialize all configured peripherals */
   MX_GPIO_Init();
+  MX_DMA_Init();
   MX_FSMC_Init();
   MX_SPI2_Init();
   /* USER CODE BEGIN 2 */
 
   lcdSetTextFont(&Font16);
   LCD_ILI9341_init();
+#ifdef tunebus
+  // fastest FSMC timing that still reads back from GRAM, 2 HCLK spare on DATAST
+  lcdTuneBusTiming(2);
+#endif
   lcd_setup_picture(1);
 
   if (W25qxx_Init()) {
@@ -219,11 +275,21 @@ int main(void)
 		lcdPrintf("BLOCK SIZE :%d\n",w25qxx.BlockSize);
 		lcdPrintf("PAGE COUNT :%d\n",w25qxx.PageCount);
 		lcdPrintf("PAGE SIZE :%d\n",w25qxx.PageSize);
+#ifdef tunebus
+		lcdPrintf("BUS W%d/%d R%d/%d %dKPX/S\n", lcdGetBusTiming().writeAddSet, lcdGetBusTiming().writeDataSet,
+				lcdGetBusTiming().readAddSet, lcdGetBusTiming().readDataSet, (int)(lcdGetBusTiming().pixelsPerSecond / 1000));
+#endif
 
 		lcdPrintf("DATA EXIST IN EXT. FLASH\n");
 		lcdPrintf("---------------------------\n");
 		lcdPrintf("-  READ EXT.  SPI  FLASH  -\n");
 		lcdPrintf("---------------------------\n");
+#ifdef textbench
+		textBench();
+#endif
+#ifdef renderbench
+		renderBench();
+#endif
 
 
 	}
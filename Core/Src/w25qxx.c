@@ -1,28 +1,171 @@
 
 #include "w25qxxConf.h"
 #include "w25qxx.h"
+#include <string.h>
 
 #if (_W25QXX_DEBUG == 1)
 #include <stdio.h>
 #endif
+#if (_W25QXX_USE_LL == 1)
+#include "stm32f1xx_ll_spi.h"
+#endif
 
 #define W25QXX_DUMMY_BYTE 0xA5
+#define W25QXX_MANUFACTURER_WINBOND 0xEF
+#define W25QXX_MANUFACTURER_GIGADEVICE 0xC8
+#define W25QXX_MANUFACTURER_MACRONIX 0xC2
 
 w25qxx_t w25qxx;
 extern SPI_HandleTypeDef _W25QXX_SPI;
+static W25qxx_Job_t *W25qxx_JobHead = NULL;
+static W25qxx_Job_t *W25qxx_JobTail = NULL;
+static bool W25qxx_JobInFlight = false;
+static bool W25qxx_JobTimedOut = false;
+static uint32_t W25qxx_JobStartTime;
+static volatile bool W25qxx_ReadPreempt = false;
+static volatile bool W25qxx_ReadWaiting = false;
+static uint32_t W25qxx_ReadStartCycle;
+W25qxx_Stats_t W25qxx_Stats[W25QXX_PRIO_COUNT];
+static bool W25qxx_Suspended = false;
+static uint32_t W25qxx_SuspendTime;
+static uint32_t W25qxx_ResumeCycle;
 #if (_W25QXX_USE_FREERTOS == 1)
 #define W25qxx_Delay(delay) osDelay(delay)
 #include "cmsis_os.h"
 #else
 #define W25qxx_Delay(delay) HAL_Delay(delay)
 #endif
+// free running cycle counter behind the us delays, suspend pacing and latency stats. W25qxx_CyclesInit/Cycles/CyclesPerUs
+// can be given on the command line to run the driver against a virtual clock, e.g. a flash model on a host build.
+#ifndef W25qxx_Cycles
+#define W25qxx_CyclesInit() (CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk, DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk)
+#define W25qxx_Cycles() (DWT->CYCCNT)
+#define W25qxx_CyclesPerUs() (SystemCoreClock / 1000000)
+#endif
 //###################################################################################################################
 uint8_t W25qxx_Spi(uint8_t Data)
 {
+#if (_W25QXX_USE_LL == 1)
+	SPI_TypeDef *Spi = _W25QXX_SPI.Instance;
+	if (!LL_SPI_IsEnabled(Spi))
+		LL_SPI_Enable(Spi);
+	while (!LL_SPI_IsActiveFlag_TXE(Spi))
+		;
+	LL_SPI_TransmitData8(Spi, Data);
+	while (!LL_SPI_IsActiveFlag_RXNE(Spi))
+		;
+	return LL_SPI_ReceiveData8(Spi);
+#else
 	uint8_t ret;
 	HAL_SPI_TransmitReceive(&_W25QXX_SPI, &Data, &ret, 1, 100);
 	return ret;
+#endif
+}
+//###################################################################################################################
+// command/address headers and other short writes, received bytes are dropped
+static void W25qxx_SpiWrite(const uint8_t *pData, uint32_t Len)
+{
+#if (_W25QXX_USE_LL == 1)
+	while (Len--)
+		W25qxx_Spi(*pData++);
+#else
+	HAL_SPI_Transmit(&_W25QXX_SPI, (uint8_t *)pData, Len, 100);
+#endif
+}
+//###################################################################################################################
+// opcode + 3 or 4 address bytes. Above 16MB either the chip sits in 4 byte address mode (set once at Init) and takes
+// the plain opcode, or it only has the dedicated 4 byte opcodes
+static void W25qxx_SpiAddressCmd(uint8_t Cmd3, uint8_t Cmd4, uint32_t Address)
+{
+	uint8_t Header[5];
+	uint8_t Len = 0;
+	Header[Len++] = w25qxx.Use4ByteCmd ? Cmd4 : Cmd3;
+	if (w25qxx.AddrBytes == 4)
+		Header[Len++] = (Address & 0xFF000000) >> 24;
+	Header[Len++] = (Address & 0xFF0000) >> 16;
+	Header[Len++] = (Address & 0xFF00) >> 8;
+	Header[Len++] = Address & 0xFF;
+	W25qxx_SpiWrite(Header, Len);
+}
+//###################################################################################################################
+static void W25qxx_FastReadHeader(uint32_t ReadAddr)
+{
+	uint8_t Header[6];
+	uint8_t Len = 0;
+	Header[Len++] = w25qxx.Use4ByteCmd ? 0x0C : 0x0B;
+	if (w25qxx.AddrBytes == 4)
+		Header[Len++] = (ReadAddr & 0xFF000000) >> 24;
+	Header[Len++] = (ReadAddr & 0xFF0000) >> 16;
+	Header[Len++] = (ReadAddr & 0xFF00) >> 8;
+	Header[Len++] = ReadAddr & 0xFF;
+	Header[Len++] = 0;
+	W25qxx_SpiWrite(Header, Len);
+}
+//###################################################################################################################
+#if (_W25QXX_CACHE_PAGES > 0)
+typedef struct
+{
+	uint32_t Tag; // page number + 1, 0 = empty
+	uint32_t LastUse;
+	uint8_t Data[256];
+
+} W25qxx_CacheLine_t;
+
+static W25qxx_CacheLine_t W25qxx_Cache[_W25QXX_CACHE_PAGES];
+static uint32_t W25qxx_CacheClock;
+static bool W25qxx_CacheBypass;
+//###################################################################################################################
+// returns the cached copy of a 256 byte page, filling the least recently used line on a miss. Lock held by caller.
+static uint8_t *W25qxx_CachePage(uint32_t Page)
+{
+	W25qxx_CacheLine_t *Line = &W25qxx_Cache[0];
+	uint8_t i;
+	for (i = 0; i < _W25QXX_CACHE_PAGES; i++)
+	{
+		if (W25qxx_Cache[i].Tag == Page + 1)
+		{
+			w25qxx.CacheHit++;
+			W25qxx_Cache[i].LastUse = ++W25qxx_CacheClock;
+			return W25qxx_Cache[i].Data;
+		}
+		if (W25qxx_Cache[i].LastUse < Line->LastUse)
+			Line = &W25qxx_Cache[i];
+	}
+	w25qxx.CacheMiss++;
+	HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_RESET);
+	W25qxx_FastReadHeader(Page * 256);
+	HAL_SPI_Receive(&_W25QXX_SPI, Line->Data, 256, 100);
+	HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_SET);
+	Line->Tag = Page + 1;
+	Line->LastUse = ++W25qxx_CacheClock;
+	return Line->Data;
+}
+//###################################################################################################################
+// drops every cached page overlapping [Address, Address + Len), called before each program/erase command
+static void W25qxx_CacheInvalidate(uint32_t Address, uint32_t Len)
+{
+	uint32_t First = Address / 256;
+	uint32_t Last = (Len > 0xFFFFFFFF - Address) ? 0xFFFFFF : (Address + Len - 1) / 256;
+	uint8_t i;
+	for (i = 0; i < _W25QXX_CACHE_PAGES; i++)
+	{
+		if ((W25qxx_Cache[i].Tag > First) && (W25qxx_Cache[i].Tag <= Last + 1))
+		{
+			W25qxx_Cache[i].Tag = 0;
+			W25qxx_Cache[i].LastUse = 0;
+		}
+	}
+}
+//###################################################################################################################
+// whether a read of this length is served from the page cache
+static bool W25qxx_CacheUse(uint32_t NumByteToRead)
+{
+	return (NumByteToRead <= _W25QXX_CACHE_MAX_READ) && !W25qxx_CacheBypass;
 }
+#else
+#define W25qxx_CacheInvalidate(Address, Len)
+#define W25qxx_CacheUse(NumByteToRead) false
+#endif
 //###################################################################################################################
 uint32_t W25qxx_ReadID(void)
 {
@@ -53,7 +196,6 @@ void W25qxx_WriteEnable(void)
 	HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_RESET);
 	W25qxx_Spi(0x06);
 	HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_SET);
-	W25qxx_Delay(1);
 }
 //###################################################################################################################
 void W25qxx_WriteDisable(void)
@@ -61,7 +203,6 @@ void W25qxx_WriteDisable(void)
 	HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_RESET);
 	W25qxx_Spi(0x04);
 	HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_SET);
-	W25qxx_Delay(1);
 }
 //###################################################################################################################
 uint8_t W25qxx_ReadStatusRegister(uint8_t SelectStatusRegister_1_2_3)
@@ -112,39 +253,262 @@ void W25qxx_WriteStatusRegister(uint8_t SelectStatusRegister_1_2_3, uint8_t Data
 	HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_SET);
 }
 //###################################################################################################################
-void W25qxx_WaitForWriteEnd(void)
+static void W25qxx_DelayUs(uint32_t Us)
+{
+	uint32_t StartCycle = W25qxx_Cycles();
+	uint32_t Cycles = Us * W25qxx_CyclesPerUs();
+	while ((W25qxx_Cycles() - StartCycle) < Cycles)
+		;
+}
+//###################################################################################################################
+// bus ownership: LDREX/STREX test-and-set, safe between thread mode and the SysTick job engine
+static bool W25qxx_TryLock(void)
+{
+	do
+	{
+		if (__LDREXB(&w25qxx.Lock) != 0)
+		{
+			__CLREX();
+			return false;
+		}
+	} while (__STREXB(1, &w25qxx.Lock) != 0);
+	__DMB();
+	return true;
+}
+//###################################################################################################################
+static void W25qxx_Lock(void)
+{
+	while (!W25qxx_TryLock())
+		W25qxx_DelayUs(_W25QXX_POLL_INTERVAL_US);
+}
+//###################################################################################################################
+static void W25qxx_Unlock(void)
+{
+	__DMB();
+	w25qxx.Lock = 0;
+}
+//###################################################################################################################
+bool W25qxx_IsBusy(void)
+{
+	return w25qxx.Lock != 0;
+}
+//###################################################################################################################
+static void W25qxx_StatsAdd(W25qxx_Prio_t Prio, uint32_t LatencyUs)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	W25qxx_Stats[Prio].Count++;
+	W25qxx_Stats[Prio].TotalUs += LatencyUs;
+	if (LatencyUs > W25qxx_Stats[Prio].MaxUs)
+		W25qxx_Stats[Prio].MaxUs = LatencyUs;
+	__set_PRIMASK(primask);
+}
+//###################################################################################################################
+bool W25qxx_WaitForWriteEnd(uint32_t Timeout_ms)
 {
-	W25qxx_Delay(1);
+	uint32_t StartTime = HAL_GetTick();
+	bool Done = true;
 	HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_RESET);
 	W25qxx_Spi(0x05);
-	do
+	// status register 1 is shifted out repeatedly while CS stays low
+	while (((w25qxx.StatusRegister1 = W25qxx_Spi(W25QXX_DUMMY_BYTE)) & 0x01) == 0x01)
 	{
-		w25qxx.StatusRegister1 = W25qxx_Spi(W25QXX_DUMMY_BYTE);
-		W25qxx_Delay(1);
-	} while ((w25qxx.StatusRegister1 & 0x01) == 0x01);
+		if ((HAL_GetTick() - StartTime) > Timeout_ms)
+		{
+			w25qxx.Timeouts++;
+			Done = false;
+			break;
+		}
+		W25qxx_DelayUs(_W25QXX_POLL_INTERVAL_US);
+	}
 	HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_SET);
+	return Done;
+}
+//###################################################################################################################
+// SUS in status register 2 on Winbond (bit 7) and GigaDevice (bits 7/2), ESB/PSB in the security register on Macronix
+static bool W25qxx_IsSuspended(void)
+{
+	uint8_t Status;
+	if (w25qxx.Manufacturer == W25QXX_MANUFACTURER_MACRONIX)
+	{
+		HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_RESET);
+		W25qxx_Spi(0x2B);
+		Status = W25qxx_Spi(W25QXX_DUMMY_BYTE);
+		HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_SET);
+		return (Status & 0x0C) != 0;
+	}
+	return (W25qxx_ReadStatusRegister(2) & 0x84) != 0;
+}
+//###################################################################################################################
+// takes the bus for a read. When a queued program/erase job is in flight and the read stays clear of its range,
+// the command is suspended (0x75) instead of waited for; chip erase can not be suspended. A Cached read fills
+// whole 256 byte pages, so those pages have to stay clear of the job, not only the bytes asked for.
+static void W25qxx_ReadLock(uint32_t ReadAddr, uint32_t NumByteToRead, bool Cached)
+{
+	W25qxx_Job_t *Job;
+	if (Cached)
+	{
+		NumByteToRead = ((ReadAddr + NumByteToRead + 255) & ~0xFFUL) - (ReadAddr & ~0xFFUL);
+		ReadAddr &= ~0xFFUL;
+	}
+	W25qxx_ReadStartCycle = W25qxx_Cycles();
+	W25qxx_ReadPreempt = true; // keeps W25qxx_JobProcess off the bus from here on
+	Job = W25qxx_JobHead;
+	if (W25qxx_JobInFlight && (Job->Type != W25QXX_JOB_ERASE_CHIP) &&
+		((ReadAddr + NumByteToRead <= Job->Address) || (ReadAddr >= Job->Address + Job->Len)))
+	{
+		if (W25qxx_ReadStatusRegister(1) & 0x01)
+		{
+			// give the array some progress between back to back suspends
+			while ((W25qxx_Cycles() - W25qxx_ResumeCycle) < _W25QXX_SUSPEND_GAP_US * W25qxx_CyclesPerUs())
+				;
+			HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_RESET);
+			W25qxx_Spi(0x75);
+			HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_SET);
+			// BUSY drops within tSUS, SUS in status register 2 tells whether it really stopped or just finished
+			W25qxx_WaitForWriteEnd(1);
+			W25qxx_Suspended = W25qxx_IsSuspended();
+			W25qxx_SuspendTime = HAL_GetTick();
+		}
+		return;
+	}
+	// raise ReadWaiting before dropping ReadPreempt, so W25qxx_JobProcess never sees both clear and grabs the lock
+	W25qxx_ReadWaiting = true;
+	W25qxx_ReadPreempt = false;
+	W25qxx_Lock();
+	W25qxx_ReadWaiting = false;
+}
+//###################################################################################################################
+static void W25qxx_ReadUnlock(void)
+{
+	W25qxx_StatsAdd(W25QXX_PRIO_INTERACTIVE, (W25qxx_Cycles() - W25qxx_ReadStartCycle) / W25qxx_CyclesPerUs());
+	if (!W25qxx_ReadPreempt)
+	{
+		W25qxx_Unlock();
+		return;
+	}
+	if (W25qxx_Suspended)
+	{
+		HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_RESET);
+		W25qxx_Spi(0x7A);
+		HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_SET);
+		W25qxx_Suspended = false;
+		W25qxx_ResumeCycle = W25qxx_Cycles();
+		// time spent suspended does not count against the job timeout
+		W25qxx_JobStartTime += HAL_GetTick() - W25qxx_SuspendTime;
+	}
+	W25qxx_ReadPreempt = false;
 }
 //###################################################################################################################
 extern int my_htoa32(char * buf, uint32_t data);
 extern char idx[];
 
-bool W25qxx_Init(void)
+//###################################################################################################################
+// typical erase times in ms from the Winbond datasheets: 4K sector, 32K, 64K, chip. Used when SFDP has none.
+static const uint32_t W25qxx_EraseTimeDefault[][4] = {
+	{45, 120, 150, 300},	// W25Q10
+	{45, 120, 150, 500},	// W25Q20
+	{45, 120, 150, 1000},	// W25Q40
+	{45, 120, 150, 2000},	// W25Q80
+	{45, 120, 150, 5000},	// W25Q16
+	{45, 120, 150, 10000},	// W25Q32
+	{45, 120, 150, 20000},	// W25Q64
+	{45, 120, 150, 40000},	// W25Q128
+	{50, 120, 150, 80000},	// W25Q256
+	{50, 150, 200, 160000}, // W25Q512
+};
+//###################################################################################################################
+static void W25qxx_ReadSfdpBytes(uint32_t Address, uint8_t *pBuffer, uint32_t Len)
 {
-	w25qxx.Lock = 1;
-	while (HAL_GetTick() < 100)
-		W25qxx_Delay(1);
+	HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_RESET);
+	W25qxx_Spi(0x5A);
+	W25qxx_Spi((Address & 0xFF0000) >> 16);
+	W25qxx_Spi((Address & 0xFF00) >> 8);
+	W25qxx_Spi(Address & 0xFF);
+	W25qxx_Spi(0);
+	HAL_SPI_Receive(&_W25QXX_SPI, pBuffer, Len, 100);
 	HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_SET);
-	W25qxx_Delay(100);
-	uint32_t id;
-#if (_W25QXX_DEBUG == 1)
-	printf("w25qxx Init Begin...\r\n");
-#endif
-	id = W25qxx_ReadID();
-	my_htoa32(&idx[0] , id);
-
+}
+//###################################################################################################################
+// JESD216 basic flash parameter table: density, erase types and typical times, 4 byte addressing.
+// DWORDs are little endian, Bfpt[n] is DWORD n+1 of the spec.
+static uint8_t W25qxx_Enter4Byte;
+static bool W25qxx_ReadSfdp(void)
+{
+	static const uint32_t EraseUnit[4] = {1, 16, 128, 1000};
+	static const uint32_t ChipUnit[4] = {16, 256, 4000, 64000};
+	static const uint8_t EraseOpcode[3] = {0x20, 0x52, 0xD8};
+	uint32_t Header[4], Bfpt[16];
+	uint32_t Size, Len, Kb, Time, i;
+	uint8_t SizeExp, Opcode, Type;
+	w25qxx.Sfdp = false;
+	W25qxx_ReadSfdpBytes(0, (uint8_t *)Header, sizeof(Header));
+	// "SFDP" signature, then the first parameter header which must be the basic table (ID 0x00)
+	if ((Header[0] != 0x50444653) || ((Header[2] & 0xFF) != 0x00))
+		return false;
+	Len = Header[2] >> 24;
+	if (Len < 9)
+		return false;
+	if (Len > 16)
+		Len = 16;
+	memset(Bfpt, 0, sizeof(Bfpt));
+	W25qxx_ReadSfdpBytes(Header[3] & 0xFFFFFF, (uint8_t *)Bfpt, Len * 4);
+	if (Bfpt[1] & 0x80000000)
+		Size = ((Bfpt[1] & 0x7FFFFFFF) > 34) ? 0 : 1UL << ((Bfpt[1] & 0x7FFFFFFF) - 3);
+	else
+		Size = (Bfpt[1] >> 3) + 1;
+	if (Size < 0x20000)
+		return false;
+	Kb = Size / 1024;
+	Type = 31 - __builtin_clz(Kb) - 6;
+	w25qxx.ID = (Type < W25Q10) ? W25Q10 : (Type > W25Q512) ? W25Q512 : (W25QXX_ID_t)Type;
+	w25qxx.BlockCount = Size / 0x10000;
+	memcpy(w25qxx.EraseTime, W25qxx_EraseTimeDefault[w25qxx.ID - 1], sizeof(w25qxx.EraseTime));
+	w25qxx.EraseTime[1] = 0xFFFFFFFF;
+	w25qxx.EraseTime[2] = 0xFFFFFFFF;
+	// erase types 1..4 in DWORD8/9, their typical times in DWORD10 (JESD216A and later). The erase code
+	// only sends 0x20/0x52/0xD8, a size listed under another opcode is treated as not there.
+	for (i = 0; i < 4; i++)
+	{
+		SizeExp = (Bfpt[7 + i / 2] >> ((i & 1) * 16)) & 0xFF;
+		Opcode = (Bfpt[7 + i / 2] >> ((i & 1) * 16 + 8)) & 0xFF;
+		if ((SizeExp != 12) && (SizeExp != 15) && (SizeExp != 16))
+			continue;
+		Type = (SizeExp == 12) ? 0 : (SizeExp == 15) ? 1 : 2;
+		if (Opcode != EraseOpcode[Type])
+			continue;
+		Time = W25qxx_EraseTimeDefault[w25qxx.ID - 1][Type];
+		if (Len >= 10)
+		{
+			Time = (Bfpt[9] >> (4 + i * 7)) & 0x7F;
+			Time = ((Time & 0x1F) + 1) * EraseUnit[Time >> 5];
+		}
+		w25qxx.EraseTime[Type] = Time;
+	}
+	if (Len >= 11)
+		w25qxx.EraseTime[3] = (((Bfpt[10] >> 24) & 0x1F) + 1) * ChipUnit[(Bfpt[10] >> 29) & 0x03];
+	// above 16MB: enter 4 byte address mode once if the part can (DWORD16, JESD216B), else use the 4 byte opcodes
+	W25qxx_Enter4Byte = 0;
+	if (Size > 0x1000000)
+	{
+		w25qxx.AddrBytes = 4;
+		if ((Len >= 16) && (Bfpt[15] & 0x03000000))
+			W25qxx_Enter4Byte = (Bfpt[15] & 0x01000000) ? 1 : 2;
+		else
+			w25qxx.Use4ByteCmd = true;
+	}
+	w25qxx.Sfdp = true;
 #if (_W25QXX_DEBUG == 1)
-	printf("w25qxx ID:0x%X\r\n", id);
+	printf("w25qxx SFDP rev %d.%d, %d KB, erase 4K:%d 32K:%d 64K:%d chip:%d ms, %d byte address%s\r\n",
+		   (Header[1] >> 8) & 0xFF, Header[1] & 0xFF, Kb, w25qxx.EraseTime[0], w25qxx.EraseTime[1], w25qxx.EraseTime[2],
+		   w25qxx.EraseTime[3], w25qxx.AddrBytes, W25qxx_Enter4Byte ? " mode" : "");
 #endif
+	return true;
+}
+//###################################################################################################################
+// fallback for parts without SFDP: geometry from the capacity byte of the JEDEC ID
+static bool W25qxx_IdToGeometry(uint32_t id)
+{
 	switch (id & 0x000000FF)
 	{
 	case 0x20: // 	w25q512
@@ -221,7 +585,44 @@ bool W25qxx_Init(void)
 #if (_W25QXX_DEBUG == 1)
 		printf("w25qxx Unknown ID\r\n");
 #endif
-		w25qxx.Lock = 0;
+		return false;
+	}
+	memcpy(w25qxx.EraseTime, W25qxx_EraseTimeDefault[w25qxx.ID - 1], sizeof(w25qxx.EraseTime));
+	// without SFDP keep to the dedicated 4 byte opcodes, as before
+	if (w25qxx.ID >= W25Q256)
+	{
+		w25qxx.AddrBytes = 4;
+		w25qxx.Use4ByteCmd = true;
+	}
+	return true;
+}
+//###################################################################################################################
+bool W25qxx_Init(void)
+{
+	w25qxx.Lock = 1;
+	W25qxx_CyclesInit();
+	HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_SET);
+	// release from power-down (tRES1 3us) in case the chip was left there, reads work right after
+	HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_RESET);
+	W25qxx_Spi(0xAB);
+	HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_SET);
+	W25qxx_DelayUs(3);
+	uint32_t id;
+#if (_W25QXX_DEBUG == 1)
+	printf("w25qxx Init Begin...\r\n");
+#endif
+	id = W25qxx_ReadID();
+	my_htoa32(&idx[0] , id);
+
+#if (_W25QXX_DEBUG == 1)
+	printf("w25qxx ID:0x%X\r\n", id);
+#endif
+	w25qxx.Manufacturer = (id >> 16) & 0xFF;
+	w25qxx.AddrBytes = 3;
+	w25qxx.Use4ByteCmd = false;
+	if (!W25qxx_ReadSfdp() && !W25qxx_IdToGeometry(id))
+	{
+		W25qxx_Unlock();
 		return false;
 	}
 	w25qxx.PageSize = 256;
@@ -230,10 +631,41 @@ bool W25qxx_Init(void)
 	w25qxx.PageCount = (w25qxx.SectorCount * w25qxx.SectorSize) / w25qxx.PageSize;
 	w25qxx.BlockSize = w25qxx.SectorSize * 16;
 	w25qxx.CapacityInKiloByte = (w25qxx.SectorCount * w25qxx.SectorSize) / 1024;
-	W25qxx_ReadUniqID();
+	// 0x4B unique ID and status registers 2/3 exist on Winbond and GigaDevice only, 0x35 is QPI enable on Macronix
+	if ((w25qxx.Manufacturer == W25QXX_MANUFACTURER_WINBOND) || (w25qxx.Manufacturer == W25QXX_MANUFACTURER_GIGADEVICE))
+	{
+		W25qxx_ReadUniqID();
+		W25qxx_ReadStatusRegister(2);
+		W25qxx_ReadStatusRegister(3);
+	}
+	if (W25qxx_Enter4Byte != 0)
+	{
+		if (W25qxx_Enter4Byte == 2)
+			W25qxx_WriteEnable();
+		HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_RESET);
+		W25qxx_Spi(0xB7);
+		HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_SET);
+	}
+	// program/erase are ignored for tPUW (10ms max) after power-up
+	while (HAL_GetTick() < 10)
+		W25qxx_Delay(1);
+#if (_W25QXX_DEBUG == 1)
+	// backend cost: a one byte status read is mostly per call overhead, a 256 byte page read is mostly
+	// the wire time, both go through W25qxx_Spi/W25qxx_SpiWrite for the header only
+	uint8_t Page[256];
+	uint32_t StatusCycles, PageCycles;
+	StatusCycles = W25qxx_Cycles();
+	W25qxx_ReadStatusRegister(1);
+	StatusCycles = W25qxx_Cycles() - StatusCycles;
+	PageCycles = W25qxx_Cycles();
+	HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_RESET);
+	W25qxx_FastReadHeader(0);
+	HAL_SPI_Receive(&_W25QXX_SPI, Page, sizeof(Page), 100);
+	HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_SET);
+	PageCycles = W25qxx_Cycles() - PageCycles;
+	printf("w25qxx LL:%d status read %d cycles, 256 byte page read %d cycles\r\n", _W25QXX_USE_LL, StatusCycles, PageCycles);
+#endif
 	W25qxx_ReadStatusRegister(1);
-	W25qxx_ReadStatusRegister(2);
-	W25qxx_ReadStatusRegister(3);
 #if (_W25QXX_DEBUG == 1)
 	printf("w25qxx Page Size: %d Bytes\r\n", w25qxx.PageSize);
 	printf("w25qxx Page Count: %d\r\n", w25qxx.PageCount);
@@ -244,99 +676,225 @@ bool W25qxx_Init(void)
 	printf("w25qxx Capacity: %d KiloBytes\r\n", w25qxx.CapacityInKiloByte);
 	printf("w25qxx Init Done\r\n");
 #endif
-	w25qxx.Lock = 0;
+	W25qxx_Unlock();
 	return true;
 }
 //###################################################################################################################
-void W25qxx_EraseChip(void)
+bool W25qxx_EraseChip(void)
 {
-	while (w25qxx.Lock == 1)
-		W25qxx_Delay(1);
-	w25qxx.Lock = 1;
+	bool Ok;
+	W25qxx_Lock();
 #if (_W25QXX_DEBUG == 1)
 	uint32_t StartTime = HAL_GetTick();
 	printf("w25qxx EraseChip Begin...\r\n");
 #endif
+	W25qxx_CacheInvalidate(0, 0xFFFFFFFF);
 	W25qxx_WriteEnable();
 	HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_RESET);
 	W25qxx_Spi(0xC7);
 	HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_SET);
-	W25qxx_WaitForWriteEnd();
+	Ok = W25qxx_WaitForWriteEnd(_W25QXX_TIMEOUT_CHIP_MS);
 #if (_W25QXX_DEBUG == 1)
 	printf("w25qxx EraseBlock done after %d ms!\r\n", HAL_GetTick() - StartTime);
 #endif
-	W25qxx_Delay(10);
-	w25qxx.Lock = 0;
+	W25qxx_Unlock();
+	return Ok;
 }
 //###################################################################################################################
-void W25qxx_EraseSector(uint32_t SectorAddr)
+bool W25qxx_EraseSector(uint32_t SectorAddr)
 {
-	while (w25qxx.Lock == 1)
-		W25qxx_Delay(1);
-	w25qxx.Lock = 1;
+	bool Ok;
+	W25qxx_Lock();
 #if (_W25QXX_DEBUG == 1)
 	uint32_t StartTime = HAL_GetTick();
 	printf("w25qxx EraseSector %d Begin...\r\n", SectorAddr);
 #endif
-	W25qxx_WaitForWriteEnd();
+	if (!W25qxx_WaitForWriteEnd(_W25QXX_TIMEOUT_SECTOR_MS))
+	{
+		W25qxx_Unlock();
+		return false;
+	}
 	SectorAddr = SectorAddr * w25qxx.SectorSize;
+	W25qxx_CacheInvalidate(SectorAddr, w25qxx.SectorSize);
 	W25qxx_WriteEnable();
 	HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_RESET);
-	if (w25qxx.ID >= W25Q256)
-	{
-		W25qxx_Spi(0x21);
-		W25qxx_Spi((SectorAddr & 0xFF000000) >> 24);
-	}
-	else
-	{
-		W25qxx_Spi(0x20);
-	}
-	W25qxx_Spi((SectorAddr & 0xFF0000) >> 16);
-	W25qxx_Spi((SectorAddr & 0xFF00) >> 8);
-	W25qxx_Spi(SectorAddr & 0xFF);
+	W25qxx_SpiAddressCmd(0x20, 0x21, SectorAddr);
 	HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_SET);
-	W25qxx_WaitForWriteEnd();
+	Ok = W25qxx_WaitForWriteEnd(_W25QXX_TIMEOUT_SECTOR_MS);
 #if (_W25QXX_DEBUG == 1)
 	printf("w25qxx EraseSector done after %d ms\r\n", HAL_GetTick() - StartTime);
 #endif
-	W25qxx_Delay(1);
-	w25qxx.Lock = 0;
+	W25qxx_Unlock();
+	return Ok;
 }
 //###################################################################################################################
-void W25qxx_EraseBlock(uint32_t BlockAddr)
+bool W25qxx_EraseBlock(uint32_t BlockAddr)
 {
-	while (w25qxx.Lock == 1)
-		W25qxx_Delay(1);
-	w25qxx.Lock = 1;
+	bool Ok;
+	W25qxx_Lock();
 #if (_W25QXX_DEBUG == 1)
 	printf("w25qxx EraseBlock %d Begin...\r\n", BlockAddr);
 	W25qxx_Delay(100);
 	uint32_t StartTime = HAL_GetTick();
 #endif
-	W25qxx_WaitForWriteEnd();
+	if (!W25qxx_WaitForWriteEnd(_W25QXX_TIMEOUT_BLOCK_MS))
+	{
+		W25qxx_Unlock();
+		return false;
+	}
 	BlockAddr = BlockAddr * w25qxx.SectorSize * 16;
+	W25qxx_CacheInvalidate(BlockAddr, w25qxx.SectorSize * 16);
 	W25qxx_WriteEnable();
 	HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_RESET);
-	if (w25qxx.ID >= W25Q256)
+	W25qxx_SpiAddressCmd(0xD8, 0xDC, BlockAddr);
+	HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_SET);
+	Ok = W25qxx_WaitForWriteEnd(_W25QXX_TIMEOUT_BLOCK_MS);
+#if (_W25QXX_DEBUG == 1)
+	printf("w25qxx EraseBlock done after %d ms\r\n", HAL_GetTick() - StartTime);
+	W25qxx_Delay(100);
+#endif
+	W25qxx_Unlock();
+	return Ok;
+}
+//###################################################################################################################
+bool W25qxx_EraseHalfBlock(uint32_t HalfBlockAddr)
+{
+	bool Ok;
+	W25qxx_Lock();
+#if (_W25QXX_DEBUG == 1)
+	printf("w25qxx EraseHalfBlock %d Begin...\r\n", HalfBlockAddr);
+	uint32_t StartTime = HAL_GetTick();
+#endif
+	if (!W25qxx_WaitForWriteEnd(_W25QXX_TIMEOUT_BLOCK_MS))
 	{
-		W25qxx_Spi(0xDC);
-		W25qxx_Spi((BlockAddr & 0xFF000000) >> 24);
+		W25qxx_Unlock();
+		return false;
 	}
+	HalfBlockAddr = HalfBlockAddr * w25qxx.SectorSize * 8;
+	W25qxx_CacheInvalidate(HalfBlockAddr, w25qxx.SectorSize * 8);
+	W25qxx_WriteEnable();
+	HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_RESET);
+	W25qxx_SpiAddressCmd(0x52, 0x5C, HalfBlockAddr);
+	HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_SET);
+	Ok = W25qxx_WaitForWriteEnd(_W25QXX_TIMEOUT_BLOCK_MS);
+#if (_W25QXX_DEBUG == 1)
+	printf("w25qxx EraseHalfBlock done after %d ms\r\n", HAL_GetTick() - StartTime);
+#endif
+	W25qxx_Unlock();
+	return Ok;
+}
+//###################################################################################################################
+// cheapest erase of sectors [First, Last) of one 64K block, blank sectors skipped if asked. Returns the
+// estimated time in ms, DryRun only plans. A DryRun stores the dirty sectors in *pPlan and a later
+// pass given the same pPlan erases from it without reading the block again.
+static uint32_t W25qxx_EraseRangeInBlock(uint32_t Block, uint8_t First, uint8_t Last, bool SkipBlank, bool DryRun, uint16_t *pPlan)
+{
+	const uint32_t *Time = w25qxx.EraseTime;
+	uint32_t Sector = Block * 16;
+	uint32_t Cost = 0, HalfCost[2];
+	uint16_t Dirty = 0;
+	bool Use32[2] = {false, false}, Use64;
+	uint8_t i, h;
+	if ((pPlan != NULL) && !DryRun)
+		Dirty = *pPlan;
 	else
 	{
-		W25qxx_Spi(0xD8);
+		for (i = First; i < Last; i++)
+		{
+			if (!SkipBlank || !W25qxx_IsEmptyRange((Sector + i) * w25qxx.SectorSize, w25qxx.SectorSize))
+				Dirty |= 1 << i;
+		}
+		if (pPlan != NULL)
+			*pPlan = Dirty;
 	}
-	W25qxx_Spi((BlockAddr & 0xFF0000) >> 16);
-	W25qxx_Spi((BlockAddr & 0xFF00) >> 8);
-	W25qxx_Spi(BlockAddr & 0xFF);
-	HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_SET);
-	W25qxx_WaitForWriteEnd();
+	if (Dirty == 0)
+		return 0;
+	for (h = 0; h < 2; h++)
+	{
+		HalfCost[h] = __builtin_popcount((Dirty >> (h * 8)) & 0xFF) * Time[0];
+		if ((HalfCost[h] > Time[1]) && (First <= h * 8) && (Last >= h * 8 + 8))
+		{
+			HalfCost[h] = Time[1];
+			Use32[h] = true;
+		}
+		Cost += HalfCost[h];
+	}
+	Use64 = (First == 0) && (Last == 16) && (Cost > Time[2]);
+	if (Use64)
+		Cost = Time[2];
+	if (DryRun)
+		return Cost;
+	if (Use64)
+	{
+		W25qxx_EraseBlock(Block);
+		return Cost;
+	}
+	for (h = 0; h < 2; h++)
+	{
+		if (Use32[h])
+		{
+			W25qxx_EraseHalfBlock(Block * 2 + h);
+			continue;
+		}
+		for (i = h * 8; i < h * 8 + 8; i++)
+		{
+			if (Dirty & (1 << i))
+				W25qxx_EraseSector(Sector + i);
+		}
+	}
+	return Cost;
+}
+//###################################################################################################################
+static uint32_t W25qxx_EraseRangePass(uint32_t FirstSector, uint32_t LastSector, bool SkipBlank, bool DryRun, uint32_t Budget, uint16_t *pPlan)
+{
+	uint32_t Block, Cost = 0;
+	uint8_t First, Last;
+	for (Block = FirstSector / 16; Block * 16 < LastSector; Block++)
+	{
+		First = (Block * 16 < FirstSector) ? FirstSector - Block * 16 : 0;
+		Last = (Block * 16 + 16 > LastSector) ? LastSector - Block * 16 : 16;
+		Cost += W25qxx_EraseRangeInBlock(Block, First, Last, SkipBlank, DryRun, (pPlan != NULL) ? &pPlan[Block] : NULL);
+		if (Cost > Budget)
+			break;
+	}
+	return Cost;
+}
+//###################################################################################################################
+bool W25qxx_EraseRange(uint32_t Address, uint32_t NumByteToErase, bool SkipBlank)
+{
+	uint32_t FirstSector, LastSector, Timeouts = w25qxx.Timeouts;
+	if ((NumByteToErase == 0) || (Address >= w25qxx.SectorCount * w25qxx.SectorSize))
+		return true;
+	FirstSector = Address / w25qxx.SectorSize;
+	LastSector = (Address + NumByteToErase + w25qxx.SectorSize - 1) / w25qxx.SectorSize;
+	if (LastSector > w25qxx.SectorCount)
+		LastSector = w25qxx.SectorCount;
 #if (_W25QXX_DEBUG == 1)
-	printf("w25qxx EraseBlock done after %d ms\r\n", HAL_GetTick() - StartTime);
-	W25qxx_Delay(100);
+	printf("w25qxx EraseRange sectors %d..%d begin...\r\n", FirstSector, LastSector - 1);
+	uint32_t StartTime = HAL_GetTick();
 #endif
-	W25qxx_Delay(1);
-	w25qxx.Lock = 0;
+	// whole chip: chip erase unless the block plan is cheaper. The blank checks of the planning pass
+	// are kept per block so the erase pass does not read the chip a second time.
+	if ((FirstSector == 0) && (LastSector == w25qxx.SectorCount))
+	{
+#if (_W25QXX_ERASE_PLAN_BLOCKS > 0)
+		static uint16_t Plan[_W25QXX_ERASE_PLAN_BLOCKS];
+		uint16_t *pPlan = (SkipBlank && (w25qxx.BlockCount <= _W25QXX_ERASE_PLAN_BLOCKS)) ? Plan : NULL;
+#else
+		uint16_t *pPlan = NULL;
+#endif
+		if (W25qxx_EraseRangePass(FirstSector, LastSector, SkipBlank, true, w25qxx.EraseTime[3], pPlan) > w25qxx.EraseTime[3])
+			W25qxx_EraseChip();
+		else
+			W25qxx_EraseRangePass(FirstSector, LastSector, SkipBlank, false, 0xFFFFFFFF, pPlan);
+	}
+	else
+		W25qxx_EraseRangePass(FirstSector, LastSector, SkipBlank, false, 0xFFFFFFFF, NULL);
+#if (_W25QXX_DEBUG == 1)
+	printf("w25qxx EraseRange done after %d ms\r\n", HAL_GetTick() - StartTime);
+#endif
+	// the per-sector erases above report through the timeout counter
+	return w25qxx.Timeouts == Timeouts;
 }
 //###################################################################################################################
 uint32_t W25qxx_PageToSector(uint32_t PageAddress)
@@ -364,291 +922,105 @@ uint32_t W25qxx_BlockToPage(uint32_t BlockAddress)
 	return (BlockAddress * w25qxx.BlockSize) / w25qxx.PageSize;
 }
 //###################################################################################################################
-bool W25qxx_IsEmptyPage(uint32_t Page_Address, uint32_t OffsetInByte, uint32_t NumByteToCheck_up_to_PageSize)
+bool W25qxx_IsEmptyRange(uint32_t Address, uint32_t NumByteToCheck)
 {
-	while (w25qxx.Lock == 1)
-		W25qxx_Delay(1);
-	w25qxx.Lock = 1;
-	if (((NumByteToCheck_up_to_PageSize + OffsetInByte) > w25qxx.PageSize) || (NumByteToCheck_up_to_PageSize == 0))
-		NumByteToCheck_up_to_PageSize = w25qxx.PageSize - OffsetInByte;
+	uint32_t Buffer[_W25QXX_STREAM_CHUNK / 4];
+	uint32_t Len, i;
+	bool Empty = true;
+	W25qxx_ReadLock(Address, NumByteToCheck, false);
 #if (_W25QXX_DEBUG == 1)
-	printf("w25qxx CheckPage:%d, Offset:%d, Bytes:%d begin...\r\n", Page_Address, OffsetInByte, NumByteToCheck_up_to_PageSize);
-	W25qxx_Delay(100);
+	printf("w25qxx CheckRange:%d, Bytes:%d begin...\r\n", Address, NumByteToCheck);
 	uint32_t StartTime = HAL_GetTick();
 #endif
-	uint8_t pBuffer[32];
-	uint32_t WorkAddress;
-	uint32_t i;
-	for (i = OffsetInByte; i < w25qxx.PageSize; i += sizeof(pBuffer))
+	HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_RESET);
+	W25qxx_FastReadHeader(Address);
+	while ((NumByteToCheck > 0) && Empty)
 	{
-		HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_RESET);
-		WorkAddress = (i + Page_Address * w25qxx.PageSize);
-		if (w25qxx.ID >= W25Q256)
-		{
-			W25qxx_Spi(0x0C);
-			W25qxx_Spi((WorkAddress & 0xFF000000) >> 24);
-		}
-		else
-		{
-			W25qxx_Spi(0x0B);
-		}
-		W25qxx_Spi((WorkAddress & 0xFF0000) >> 16);
-		W25qxx_Spi((WorkAddress & 0xFF00) >> 8);
-		W25qxx_Spi(WorkAddress & 0xFF);
-		W25qxx_Spi(0);
-		HAL_SPI_Receive(&_W25QXX_SPI, pBuffer, sizeof(pBuffer), 100);
-		HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_SET);
-		for (uint8_t x = 0; x < sizeof(pBuffer); x++)
-		{
-			if (pBuffer[x] != 0xFF)
-				goto NOT_EMPTY;
-		}
-	}
-	if ((w25qxx.PageSize + OffsetInByte) % sizeof(pBuffer) != 0)
-	{
-		i -= sizeof(pBuffer);
-		for (; i < w25qxx.PageSize; i++)
+		Len = (NumByteToCheck > sizeof(Buffer)) ? sizeof(Buffer) : NumByteToCheck;
+#if (_W25QXX_USE_DMA == 1)
+		HAL_SPI_Receive_DMA(&_W25QXX_SPI, (uint8_t *)Buffer, Len);
+		while (HAL_SPI_GetState(&_W25QXX_SPI) != HAL_SPI_STATE_READY)
+			;
+#else
+		HAL_SPI_Receive(&_W25QXX_SPI, (uint8_t *)Buffer, Len, 100);
+#endif
+		for (i = 0; i < Len / 4; i++)
 		{
-			HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_RESET);
-			WorkAddress = (i + Page_Address * w25qxx.PageSize);
-			W25qxx_Spi(0x0B);
-			if (w25qxx.ID >= W25Q256)
+			if (Buffer[i] != 0xFFFFFFFF)
 			{
-				W25qxx_Spi(0x0C);
-				W25qxx_Spi((WorkAddress & 0xFF000000) >> 24);
+				Empty = false;
+				break;
 			}
-			else
-			{
-				W25qxx_Spi(0x0B);
-			}
-			W25qxx_Spi((WorkAddress & 0xFF0000) >> 16);
-			W25qxx_Spi((WorkAddress & 0xFF00) >> 8);
-			W25qxx_Spi(WorkAddress & 0xFF);
-			W25qxx_Spi(0);
-			HAL_SPI_Receive(&_W25QXX_SPI, pBuffer, 1, 100);
-			HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_SET);
-			if (pBuffer[0] != 0xFF)
-				goto NOT_EMPTY;
 		}
+		for (i *= 4; Empty && (i < Len); i++)
+		{
+			if (((uint8_t *)Buffer)[i] != 0xFF)
+				Empty = false;
+		}
+		NumByteToCheck -= Len;
 	}
+	// a fast read may be cut short at any point by raising CS
+	HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_SET);
 #if (_W25QXX_DEBUG == 1)
-	printf("w25qxx CheckPage is Empty in %d ms\r\n", HAL_GetTick() - StartTime);
-	W25qxx_Delay(100);
-#endif
-	w25qxx.Lock = 0;
-	return true;
-NOT_EMPTY:
-#if (_W25QXX_DEBUG == 1)
-	printf("w25qxx CheckPage is Not Empty in %d ms\r\n", HAL_GetTick() - StartTime);
-	W25qxx_Delay(100);
+	printf("w25qxx CheckRange is %s in %d ms\r\n", Empty ? "Empty" : "Not Empty", HAL_GetTick() - StartTime);
 #endif
-	w25qxx.Lock = 0;
-	return false;
+	W25qxx_ReadUnlock();
+	return Empty;
+}
+//###################################################################################################################
+bool W25qxx_IsEmptyPage(uint32_t Page_Address, uint32_t OffsetInByte, uint32_t NumByteToCheck_up_to_PageSize)
+{
+	if (((NumByteToCheck_up_to_PageSize + OffsetInByte) > w25qxx.PageSize) || (NumByteToCheck_up_to_PageSize == 0))
+		NumByteToCheck_up_to_PageSize = w25qxx.PageSize - OffsetInByte;
+	return W25qxx_IsEmptyRange(Page_Address * w25qxx.PageSize + OffsetInByte, NumByteToCheck_up_to_PageSize);
 }
 //###################################################################################################################
 bool W25qxx_IsEmptySector(uint32_t Sector_Address, uint32_t OffsetInByte, uint32_t NumByteToCheck_up_to_SectorSize)
 {
-	while (w25qxx.Lock == 1)
-		W25qxx_Delay(1);
-	w25qxx.Lock = 1;
-	if ((NumByteToCheck_up_to_SectorSize > w25qxx.SectorSize) || (NumByteToCheck_up_to_SectorSize == 0))
-		NumByteToCheck_up_to_SectorSize = w25qxx.SectorSize;
-#if (_W25QXX_DEBUG == 1)
-	printf("w25qxx CheckSector:%d, Offset:%d, Bytes:%d begin...\r\n", Sector_Address, OffsetInByte, NumByteToCheck_up_to_SectorSize);
-	W25qxx_Delay(100);
-	uint32_t StartTime = HAL_GetTick();
-#endif
-	uint8_t pBuffer[32];
-	uint32_t WorkAddress;
-	uint32_t i;
-	for (i = OffsetInByte; i < w25qxx.SectorSize; i += sizeof(pBuffer))
-	{
-		HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_RESET);
-		WorkAddress = (i + Sector_Address * w25qxx.SectorSize);
-		if (w25qxx.ID >= W25Q256)
-		{
-			W25qxx_Spi(0x0C);
-			W25qxx_Spi((WorkAddress & 0xFF000000) >> 24);
-		}
-		else
-		{
-			W25qxx_Spi(0x0B);
-		}
-		W25qxx_Spi((WorkAddress & 0xFF0000) >> 16);
-		W25qxx_Spi((WorkAddress & 0xFF00) >> 8);
-		W25qxx_Spi(WorkAddress & 0xFF);
-		W25qxx_Spi(0);
-		HAL_SPI_Receive(&_W25QXX_SPI, pBuffer, sizeof(pBuffer), 100);
-		HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_SET);
-		for (uint8_t x = 0; x < sizeof(pBuffer); x++)
-		{
-			if (pBuffer[x] != 0xFF)
-				goto NOT_EMPTY;
-		}
-	}
-	if ((w25qxx.SectorSize + OffsetInByte) % sizeof(pBuffer) != 0)
-	{
-		i -= sizeof(pBuffer);
-		for (; i < w25qxx.SectorSize; i++)
-		{
-			HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_RESET);
-			WorkAddress = (i + Sector_Address * w25qxx.SectorSize);
-			if (w25qxx.ID >= W25Q256)
-			{
-				W25qxx_Spi(0x0C);
-				W25qxx_Spi((WorkAddress & 0xFF000000) >> 24);
-			}
-			else
-			{
-				W25qxx_Spi(0x0B);
-			}
-			W25qxx_Spi((WorkAddress & 0xFF0000) >> 16);
-			W25qxx_Spi((WorkAddress & 0xFF00) >> 8);
-			W25qxx_Spi(WorkAddress & 0xFF);
-			W25qxx_Spi(0);
-			HAL_SPI_Receive(&_W25QXX_SPI, pBuffer, 1, 100);
-			HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_SET);
-			if (pBuffer[0] != 0xFF)
-				goto NOT_EMPTY;
-		}
-	}
-#if (_W25QXX_DEBUG == 1)
-	printf("w25qxx CheckSector is Empty in %d ms\r\n", HAL_GetTick() - StartTime);
-	W25qxx_Delay(100);
-#endif
-	w25qxx.Lock = 0;
-	return true;
-NOT_EMPTY:
-#if (_W25QXX_DEBUG == 1)
-	printf("w25qxx CheckSector is Not Empty in %d ms\r\n", HAL_GetTick() - StartTime);
-	W25qxx_Delay(100);
-#endif
-	w25qxx.Lock = 0;
-	return false;
+	if (((NumByteToCheck_up_to_SectorSize + OffsetInByte) > w25qxx.SectorSize) || (NumByteToCheck_up_to_SectorSize == 0))
+		NumByteToCheck_up_to_SectorSize = w25qxx.SectorSize - OffsetInByte;
+	return W25qxx_IsEmptyRange(Sector_Address * w25qxx.SectorSize + OffsetInByte, NumByteToCheck_up_to_SectorSize);
 }
 //###################################################################################################################
 bool W25qxx_IsEmptyBlock(uint32_t Block_Address, uint32_t OffsetInByte, uint32_t NumByteToCheck_up_to_BlockSize)
 {
-	while (w25qxx.Lock == 1)
-		W25qxx_Delay(1);
-	w25qxx.Lock = 1;
-	if ((NumByteToCheck_up_to_BlockSize > w25qxx.BlockSize) || (NumByteToCheck_up_to_BlockSize == 0))
-		NumByteToCheck_up_to_BlockSize = w25qxx.BlockSize;
-#if (_W25QXX_DEBUG == 1)
-	printf("w25qxx CheckBlock:%d, Offset:%d, Bytes:%d begin...\r\n", Block_Address, OffsetInByte, NumByteToCheck_up_to_BlockSize);
-	W25qxx_Delay(100);
-	uint32_t StartTime = HAL_GetTick();
-#endif
-	uint8_t pBuffer[32];
-	uint32_t WorkAddress;
-	uint32_t i;
-	for (i = OffsetInByte; i < w25qxx.BlockSize; i += sizeof(pBuffer))
-	{
-		HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_RESET);
-		WorkAddress = (i + Block_Address * w25qxx.BlockSize);
-
-		if (w25qxx.ID >= W25Q256)
-		{
-			W25qxx_Spi(0x0C);
-			W25qxx_Spi((WorkAddress & 0xFF000000) >> 24);
-		}
-		else
-		{
-			W25qxx_Spi(0x0B);
-		}
-		W25qxx_Spi((WorkAddress & 0xFF0000) >> 16);
-		W25qxx_Spi((WorkAddress & 0xFF00) >> 8);
-		W25qxx_Spi(WorkAddress & 0xFF);
-		W25qxx_Spi(0);
-		HAL_SPI_Receive(&_W25QXX_SPI, pBuffer, sizeof(pBuffer), 100);
-		HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_SET);
-		for (uint8_t x = 0; x < sizeof(pBuffer); x++)
-		{
-			if (pBuffer[x] != 0xFF)
-				goto NOT_EMPTY;
-		}
-	}
-	if ((w25qxx.BlockSize + OffsetInByte) % sizeof(pBuffer) != 0)
-	{
-		i -= sizeof(pBuffer);
-		for (; i < w25qxx.BlockSize; i++)
-		{
-			HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_RESET);
-			WorkAddress = (i + Block_Address * w25qxx.BlockSize);
-
-			if (w25qxx.ID >= W25Q256)
-			{
-				W25qxx_Spi(0x0C);
-				W25qxx_Spi((WorkAddress & 0xFF000000) >> 24);
-			}
-			else
-			{
-				W25qxx_Spi(0x0B);
-			}
-			W25qxx_Spi((WorkAddress & 0xFF0000) >> 16);
-			W25qxx_Spi((WorkAddress & 0xFF00) >> 8);
-			W25qxx_Spi(WorkAddress & 0xFF);
-			W25qxx_Spi(0);
-			HAL_SPI_Receive(&_W25QXX_SPI, pBuffer, 1, 100);
-			HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_SET);
-			if (pBuffer[0] != 0xFF)
-				goto NOT_EMPTY;
-		}
-	}
-#if (_W25QXX_DEBUG == 1)
-	printf("w25qxx CheckBlock is Empty in %d ms\r\n", HAL_GetTick() - StartTime);
-	W25qxx_Delay(100);
-#endif
-	w25qxx.Lock = 0;
-	return true;
-NOT_EMPTY:
-#if (_W25QXX_DEBUG == 1)
-	printf("w25qxx CheckBlock is Not Empty in %d ms\r\n", HAL_GetTick() - StartTime);
-	W25qxx_Delay(100);
-#endif
-	w25qxx.Lock = 0;
-	return false;
+	if (((NumByteToCheck_up_to_BlockSize + OffsetInByte) > w25qxx.BlockSize) || (NumByteToCheck_up_to_BlockSize == 0))
+		NumByteToCheck_up_to_BlockSize = w25qxx.BlockSize - OffsetInByte;
+	return W25qxx_IsEmptyRange(Block_Address * w25qxx.BlockSize + OffsetInByte, NumByteToCheck_up_to_BlockSize);
 }
 //###################################################################################################################
-void W25qxx_WriteByte(uint8_t pBuffer, uint32_t WriteAddr_inBytes)
+bool W25qxx_WriteByte(uint8_t pBuffer, uint32_t WriteAddr_inBytes)
 {
-	while (w25qxx.Lock == 1)
-		W25qxx_Delay(1);
-	w25qxx.Lock = 1;
+	bool Ok;
+	W25qxx_Lock();
 #if (_W25QXX_DEBUG == 1)
 	uint32_t StartTime = HAL_GetTick();
 	printf("w25qxx WriteByte 0x%02X at address %d begin...", pBuffer, WriteAddr_inBytes);
 #endif
-	W25qxx_WaitForWriteEnd();
+	if (!W25qxx_WaitForWriteEnd(_W25QXX_TIMEOUT_PAGE_MS))
+	{
+		W25qxx_Unlock();
+		return false;
+	}
+	W25qxx_CacheInvalidate(WriteAddr_inBytes, 1);
 	W25qxx_WriteEnable();
 	HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_RESET);
 
-	if (w25qxx.ID >= W25Q256)
-	{
-		W25qxx_Spi(0x12);
-		W25qxx_Spi((WriteAddr_inBytes & 0xFF000000) >> 24);
-	}
-	else
-	{
-		W25qxx_Spi(0x02);
-	}
-	W25qxx_Spi((WriteAddr_inBytes & 0xFF0000) >> 16);
-	W25qxx_Spi((WriteAddr_inBytes & 0xFF00) >> 8);
-	W25qxx_Spi(WriteAddr_inBytes & 0xFF);
+	W25qxx_SpiAddressCmd(0x02, 0x12, WriteAddr_inBytes);
 	W25qxx_Spi(pBuffer);
 	HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_SET);
-	W25qxx_WaitForWriteEnd();
+	Ok = W25qxx_WaitForWriteEnd(_W25QXX_TIMEOUT_PAGE_MS);
 #if (_W25QXX_DEBUG == 1)
 	printf("w25qxx WriteByte done after %d ms\r\n", HAL_GetTick() - StartTime);
 #endif
-	w25qxx.Lock = 0;
+	W25qxx_Unlock();
+	return Ok;
 }
 //###################################################################################################################
-void W25qxx_WritePage(uint8_t *pBuffer, uint32_t Page_Address, uint32_t OffsetInByte, uint32_t NumByteToWrite_up_to_PageSize)
+bool W25qxx_WritePage(uint8_t *pBuffer, uint32_t Page_Address, uint32_t OffsetInByte, uint32_t NumByteToWrite_up_to_PageSize)
 {
-	while (w25qxx.Lock == 1)
-		W25qxx_Delay(1);
-	w25qxx.Lock = 1;
+	bool Ok;
+	W25qxx_Lock();
 	if (((NumByteToWrite_up_to_PageSize + OffsetInByte) > w25qxx.PageSize) || (NumByteToWrite_up_to_PageSize == 0))
 		NumByteToWrite_up_to_PageSize = w25qxx.PageSize - OffsetInByte;
 	if ((OffsetInByte + NumByteToWrite_up_to_PageSize) > w25qxx.PageSize)
@@ -658,25 +1030,19 @@ void W25qxx_WritePage(uint8_t *pBuffer, uint32_t Page_Address, uint32_t OffsetIn
 	W25qxx_Delay(100);
 	uint32_t StartTime = HAL_GetTick();
 #endif
-	W25qxx_WaitForWriteEnd();
-	W25qxx_WriteEnable();
-	HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_RESET);
-	Page_Address = (Page_Address * w25qxx.PageSize) + OffsetInByte;
-	if (w25qxx.ID >= W25Q256)
-	{
-		W25qxx_Spi(0x12);
-		W25qxx_Spi((Page_Address & 0xFF000000) >> 24);
-	}
-	else
+	if (!W25qxx_WaitForWriteEnd(_W25QXX_TIMEOUT_PAGE_MS))
 	{
-		W25qxx_Spi(0x02);
+		W25qxx_Unlock();
+		return false;
 	}
-	W25qxx_Spi((Page_Address & 0xFF0000) >> 16);
-	W25qxx_Spi((Page_Address & 0xFF00) >> 8);
-	W25qxx_Spi(Page_Address & 0xFF);
+	Page_Address = (Page_Address * w25qxx.PageSize) + OffsetInByte;
+	W25qxx_CacheInvalidate(Page_Address, NumByteToWrite_up_to_PageSize);
+	W25qxx_WriteEnable();
+	HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_RESET);
+	W25qxx_SpiAddressCmd(0x02, 0x12, Page_Address);
 	HAL_SPI_Transmit(&_W25QXX_SPI, pBuffer, NumByteToWrite_up_to_PageSize, 100);
 	HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_SET);
-	W25qxx_WaitForWriteEnd();
+	Ok = W25qxx_WaitForWriteEnd(_W25QXX_TIMEOUT_PAGE_MS);
 #if (_W25QXX_DEBUG == 1)
 	StartTime = HAL_GetTick() - StartTime;
 	for (uint32_t i = 0; i < NumByteToWrite_up_to_PageSize; i++)
@@ -692,11 +1058,11 @@ void W25qxx_WritePage(uint8_t *pBuffer, uint32_t Page_Address, uint32_t OffsetIn
 	printf("w25qxx WritePage done after %d ms\r\n", StartTime);
 	W25qxx_Delay(100);
 #endif
-	W25qxx_Delay(1);
-	w25qxx.Lock = 0;
+	W25qxx_Unlock();
+	return Ok;
 }
 //###################################################################################################################
-void W25qxx_WriteSector(uint8_t *pBuffer, uint32_t Sector_Address, uint32_t OffsetInByte, uint32_t NumByteToWrite_up_to_SectorSize)
+bool W25qxx_WriteSector(uint8_t *pBuffer, uint32_t Sector_Address, uint32_t OffsetInByte, uint32_t NumByteToWrite_up_to_SectorSize)
 {
 	if ((NumByteToWrite_up_to_SectorSize > w25qxx.SectorSize) || (NumByteToWrite_up_to_SectorSize == 0))
 		NumByteToWrite_up_to_SectorSize = w25qxx.SectorSize;
@@ -710,7 +1076,7 @@ void W25qxx_WriteSector(uint8_t *pBuffer, uint32_t Sector_Address, uint32_t Offs
 		printf("---w25qxx WriteSector Faild!\r\n");
 		W25qxx_Delay(100);
 #endif
-		return;
+		return false;
 	}
 	uint32_t StartPage;
 	int32_t BytesToWrite;
@@ -723,7 +1089,8 @@ void W25qxx_WriteSector(uint8_t *pBuffer, uint32_t Sector_Address, uint32_t Offs
 	LocalOffset = OffsetInByte % w25qxx.PageSize;
 	do
 	{
-		W25qxx_WritePage(pBuffer, StartPage, LocalOffset, BytesToWrite);
+		if (!W25qxx_WritePage(pBuffer, StartPage, LocalOffset, BytesToWrite))
+			return false;
 		StartPage++;
 		BytesToWrite -= w25qxx.PageSize - LocalOffset;
 		pBuffer += w25qxx.PageSize - LocalOffset;
@@ -733,9 +1100,10 @@ void W25qxx_WriteSector(uint8_t *pBuffer, uint32_t Sector_Address, uint32_t Offs
 	printf("---w25qxx WriteSector Done\r\n");
 	W25qxx_Delay(100);
 #endif
+	return true;
 }
 //###################################################################################################################
-void W25qxx_WriteBlock(uint8_t *pBuffer, uint32_t Block_Address, uint32_t OffsetInByte, uint32_t NumByteToWrite_up_to_BlockSize)
+bool W25qxx_WriteBlock(uint8_t *pBuffer, uint32_t Block_Address, uint32_t OffsetInByte, uint32_t NumByteToWrite_up_to_BlockSize)
 {
 	if ((NumByteToWrite_up_to_BlockSize > w25qxx.BlockSize) || (NumByteToWrite_up_to_BlockSize == 0))
 		NumByteToWrite_up_to_BlockSize = w25qxx.BlockSize;
@@ -749,7 +1117,7 @@ void W25qxx_WriteBlock(uint8_t *pBuffer, uint32_t Block_Address, uint32_t Offset
 		printf("---w25qxx WriteBlock Faild!\r\n");
 		W25qxx_Delay(100);
 #endif
-		return;
+		return false;
 	}
 	uint32_t StartPage;
 	int32_t BytesToWrite;
@@ -762,7 +1130,8 @@ void W25qxx_WriteBlock(uint8_t *pBuffer, uint32_t Block_Address, uint32_t Offset
 	LocalOffset = OffsetInByte % w25qxx.PageSize;
 	do
 	{
-		W25qxx_WritePage(pBuffer, StartPage, LocalOffset, BytesToWrite);
+		if (!W25qxx_WritePage(pBuffer, StartPage, LocalOffset, BytesToWrite))
+			return false;
 		StartPage++;
 		BytesToWrite -= w25qxx.PageSize - LocalOffset;
 		pBuffer += w25qxx.PageSize - LocalOffset;
@@ -772,66 +1141,67 @@ void W25qxx_WriteBlock(uint8_t *pBuffer, uint32_t Block_Address, uint32_t Offset
 	printf("---w25qxx WriteBlock Done\r\n");
 	W25qxx_Delay(100);
 #endif
+	return true;
 }
 //###################################################################################################################
 void W25qxx_ReadByte(uint8_t *pBuffer, uint32_t Bytes_Address)
 {
-	while (w25qxx.Lock == 1)
-		W25qxx_Delay(1);
-	w25qxx.Lock = 1;
+	W25qxx_ReadLock(Bytes_Address, 1, W25qxx_CacheUse(1));
 #if (_W25QXX_DEBUG == 1)
 	uint32_t StartTime = HAL_GetTick();
 	printf("w25qxx ReadByte at address %d begin...\r\n", Bytes_Address);
 #endif
-	HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_RESET);
-
-	if (w25qxx.ID >= W25Q256)
-	{
-		W25qxx_Spi(0x0C);
-		W25qxx_Spi((Bytes_Address & 0xFF000000) >> 24);
-	}
-	else
+#if (_W25QXX_CACHE_PAGES > 0)
+	if (W25qxx_CacheUse(1))
 	{
-		W25qxx_Spi(0x0B);
+		*pBuffer = W25qxx_CachePage(Bytes_Address / 256)[Bytes_Address % 256];
+		W25qxx_ReadUnlock();
+		return;
 	}
-	W25qxx_Spi((Bytes_Address & 0xFF0000) >> 16);
-	W25qxx_Spi((Bytes_Address & 0xFF00) >> 8);
-	W25qxx_Spi(Bytes_Address & 0xFF);
-	W25qxx_Spi(0);
+#endif
+	HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_RESET);
+
+	W25qxx_FastReadHeader(Bytes_Address);
 	*pBuffer = W25qxx_Spi(W25QXX_DUMMY_BYTE);
 	HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_SET);
 #if (_W25QXX_DEBUG == 1)
 	printf("w25qxx ReadByte 0x%02X done after %d ms\r\n", *pBuffer, HAL_GetTick() - StartTime);
 #endif
-	w25qxx.Lock = 0;
+	W25qxx_ReadUnlock();
 }
 //###################################################################################################################
 void W25qxx_ReadBytes(uint8_t *pBuffer, uint32_t ReadAddr, uint32_t NumByteToRead)
 {
-	while (w25qxx.Lock == 1)
-		W25qxx_Delay(1);
-	w25qxx.Lock = 1;
+	W25qxx_ReadLock(ReadAddr, NumByteToRead, W25qxx_CacheUse(NumByteToRead));
 #if (_W25QXX_DEBUG == 1)
 	uint32_t StartTime = HAL_GetTick();
 	printf("w25qxx ReadBytes at Address:%d, %d Bytes  begin...\r\n", ReadAddr, NumByteToRead);
 #endif
-	HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_RESET);
-
-	if (w25qxx.ID >= W25Q256)
+#if (_W25QXX_CACHE_PAGES > 0)
+	// small reads go through the page cache, bulk reads stream straight from the chip
+	if (W25qxx_CacheUse(NumByteToRead))
 	{
-		W25qxx_Spi(0x0C);
-		W25qxx_Spi((ReadAddr & 0xFF000000) >> 24);
+		uint8_t *pDst = pBuffer;
+		uint32_t Addr = ReadAddr, Left = NumByteToRead, Len;
+		while (Left > 0)
+		{
+			Len = 256 - (Addr % 256);
+			if (Len > Left)
+				Len = Left;
+			memcpy(pDst, &W25qxx_CachePage(Addr / 256)[Addr % 256], Len);
+			pDst += Len;
+			Addr += Len;
+			Left -= Len;
+		}
 	}
 	else
+#endif
 	{
-		W25qxx_Spi(0x0B);
+		HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_RESET);
+		W25qxx_FastReadHeader(ReadAddr);
+		HAL_SPI_Receive(&_W25QXX_SPI, pBuffer, NumByteToRead, 2000);
+		HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_SET);
 	}
-	W25qxx_Spi((ReadAddr & 0xFF0000) >> 16);
-	W25qxx_Spi((ReadAddr & 0xFF00) >> 8);
-	W25qxx_Spi(ReadAddr & 0xFF);
-	W25qxx_Spi(0);
-	HAL_SPI_Receive(&_W25QXX_SPI, pBuffer, NumByteToRead, 2000);
-	HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_SET);
 #if (_W25QXX_DEBUG == 1)
 	StartTime = HAL_GetTick() - StartTime;
 	for (uint32_t i = 0; i < NumByteToRead; i++)
@@ -847,15 +1217,83 @@ void W25qxx_ReadBytes(uint8_t *pBuffer, uint32_t ReadAddr, uint32_t NumByteToRea
 	printf("w25qxx ReadBytes done after %d ms\r\n", StartTime);
 	W25qxx_Delay(100);
 #endif
-	W25qxx_Delay(1);
-	w25qxx.Lock = 0;
+	W25qxx_ReadUnlock();
+}
+//###################################################################################################################
+#if (_W25QXX_DEBUG == 1) && (_W25QXX_CACHE_PAGES > 0)
+// random 4 byte reads over a window twice the cache size, uncached then cached, average latency in DWT cycles
+void W25qxx_CacheBenchmark(uint32_t NumReads)
+{
+	uint32_t Window = _W25QXX_CACHE_PAGES * 256 * 2;
+	uint32_t Seed, Cycles, Hit, Miss, i;
+	uint8_t Data[4];
+	uint8_t Pass;
+	for (Pass = 0; Pass < 2; Pass++)
+	{
+		W25qxx_CacheBypass = (Pass == 0);
+		Seed = 12345;
+		Hit = w25qxx.CacheHit;
+		Miss = w25qxx.CacheMiss;
+		Cycles = W25qxx_Cycles();
+		for (i = 0; i < NumReads; i++)
+		{
+			Seed = Seed * 1103515245 + 12345;
+			W25qxx_ReadBytes(Data, (Seed >> 8) % (Window - 4), 4);
+		}
+		Cycles = (W25qxx_Cycles() - Cycles) / NumReads;
+		printf("w25qxx CacheBenchmark %s: %d cycles (%d us) per read, %d hits, %d misses\r\n", Pass ? "cached" : "uncached",
+			   Cycles, Cycles / W25qxx_CyclesPerUs(), w25qxx.CacheHit - Hit, w25qxx.CacheMiss - Miss);
+	}
+	W25qxx_CacheBypass = false;
+}
+#endif
+//###################################################################################################################
+// requests in ascending address order that sit within _W25QXX_MERGE_GAP bytes of each other share one fast read,
+// the gap is clocked out and dropped
+void W25qxx_ReadBatch(const W25qxx_ReadReq_t *pReq, uint32_t NumReq)
+{
+	uint8_t Gap[_W25QXX_MERGE_GAP + 1];
+	uint32_t First, Last, Pos = 0, i;
+	bool Open = false;
+	if (NumReq == 0)
+		return;
+	First = pReq[0].Address;
+	Last = pReq[0].Address + pReq[0].Len;
+	for (i = 1; i < NumReq; i++)
+	{
+		if (pReq[i].Address < First)
+			First = pReq[i].Address;
+		if (pReq[i].Address + pReq[i].Len > Last)
+			Last = pReq[i].Address + pReq[i].Len;
+	}
+	W25qxx_ReadLock(First, Last - First, false);
+	for (i = 0; i < NumReq; i++)
+	{
+		if (Open && ((pReq[i].Address < Pos) || (pReq[i].Address - Pos > _W25QXX_MERGE_GAP)))
+		{
+			HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_SET);
+			Open = false;
+		}
+		if (!Open)
+		{
+			HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_RESET);
+			W25qxx_FastReadHeader(pReq[i].Address);
+			Open = true;
+		}
+		else if (pReq[i].Address > Pos)
+		{
+			HAL_SPI_Receive(&_W25QXX_SPI, Gap, pReq[i].Address - Pos, 100);
+		}
+		HAL_SPI_Receive(&_W25QXX_SPI, pReq[i].pBuffer, pReq[i].Len, 2000);
+		Pos = pReq[i].Address + pReq[i].Len;
+	}
+	HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_SET);
+	W25qxx_ReadUnlock();
 }
 //###################################################################################################################
 void W25qxx_ReadPage(uint8_t *pBuffer, uint32_t Page_Address, uint32_t OffsetInByte, uint32_t NumByteToRead_up_to_PageSize)
 {
-	while (w25qxx.Lock == 1)
-		W25qxx_Delay(1);
-	w25qxx.Lock = 1;
+	W25qxx_ReadLock(Page_Address * w25qxx.PageSize, w25qxx.PageSize, false);
 	if ((NumByteToRead_up_to_PageSize > w25qxx.PageSize) || (NumByteToRead_up_to_PageSize == 0))
 		NumByteToRead_up_to_PageSize = w25qxx.PageSize;
 	if ((OffsetInByte + NumByteToRead_up_to_PageSize) > w25qxx.PageSize)
@@ -867,19 +1305,7 @@ void W25qxx_ReadPage(uint8_t *pBuffer, uint32_t Page_Address, uint32_t OffsetInB
 #endif
 	Page_Address = Page_Address * w25qxx.PageSize + OffsetInByte;
 	HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_RESET);
-	if (w25qxx.ID >= W25Q256)
-	{
-		W25qxx_Spi(0x0C);
-		W25qxx_Spi((Page_Address & 0xFF000000) >> 24);
-	}
-	else
-	{
-		W25qxx_Spi(0x0B);
-	}
-	W25qxx_Spi((Page_Address & 0xFF0000) >> 16);
-	W25qxx_Spi((Page_Address & 0xFF00) >> 8);
-	W25qxx_Spi(Page_Address & 0xFF);
-	W25qxx_Spi(0);
+	W25qxx_FastReadHeader(Page_Address);
 	HAL_SPI_Receive(&_W25QXX_SPI, pBuffer, NumByteToRead_up_to_PageSize, 100);
 	HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_SET);
 #if (_W25QXX_DEBUG == 1)
@@ -897,8 +1323,7 @@ void W25qxx_ReadPage(uint8_t *pBuffer, uint32_t Page_Address, uint32_t OffsetInB
 	printf("w25qxx ReadPage done after %d ms\r\n", StartTime);
 	W25qxx_Delay(100);
 #endif
-	W25qxx_Delay(1);
-	w25qxx.Lock = 0;
+	W25qxx_ReadUnlock();
 }
 //###################################################################################################################
 void W25qxx_ReadSector(uint8_t *pBuffer, uint32_t Sector_Address, uint32_t OffsetInByte, uint32_t NumByteToRead_up_to_SectorSize)
@@ -979,3 +1404,520 @@ void W25qxx_ReadBlock(uint8_t *pBuffer, uint32_t Block_Address, uint32_t OffsetI
 #endif
 }
 //###################################################################################################################
+void W25qxx_ReadStream(uint32_t ReadAddr, uint32_t NumByteToRead, W25qxx_StreamSink_t Sink)
+{
+	uint32_t Chunk[_W25QXX_STREAM_CHUNK / 4];
+	uint32_t Len;
+	W25qxx_ReadLock(ReadAddr, NumByteToRead, false);
+#if (_W25QXX_DEBUG == 1)
+	uint32_t StartTime = HAL_GetTick();
+	printf("w25qxx ReadStream at Address:%d, %d Bytes  begin...\r\n", ReadAddr, NumByteToRead);
+#endif
+	HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_RESET);
+	W25qxx_FastReadHeader(ReadAddr);
+	while (NumByteToRead > 0)
+	{
+		Len = (NumByteToRead > sizeof(Chunk)) ? sizeof(Chunk) : NumByteToRead;
+		HAL_SPI_Receive(&_W25QXX_SPI, (uint8_t *)Chunk, Len, 100);
+		Sink((uint8_t *)Chunk, Len);
+		NumByteToRead -= Len;
+	}
+	HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_SET);
+#if (_W25QXX_DEBUG == 1)
+	printf("w25qxx ReadStream done after %d ms\r\n", HAL_GetTick() - StartTime);
+#endif
+	W25qxx_ReadUnlock();
+}
+//###################################################################################################################
+void W25qxx_ReadStreamDMA(uint32_t ReadAddr, uint32_t NumByteToRead, W25qxx_StreamSink_t Sink)
+{
+#if (_W25QXX_USE_DMA == 1)
+	static uint32_t PingPong[2][_W25QXX_STREAM_CHUNK / 4];
+	uint32_t Len, DoneLen;
+	uint8_t Fill = 0, Done;
+	W25qxx_ReadLock(ReadAddr, NumByteToRead, false);
+#if (_W25QXX_DEBUG == 1)
+	uint32_t StartTime = HAL_GetTick();
+	printf("w25qxx ReadStreamDMA at Address:%d, %d Bytes  begin...\r\n", ReadAddr, NumByteToRead);
+#endif
+	HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_RESET);
+	W25qxx_FastReadHeader(ReadAddr);
+	Len = (NumByteToRead > sizeof(PingPong[0])) ? sizeof(PingPong[0]) : NumByteToRead;
+	if (Len > 0)
+		HAL_SPI_Receive_DMA(&_W25QXX_SPI, (uint8_t *)PingPong[Fill], Len);
+	NumByteToRead -= Len;
+	while (Len > 0)
+	{
+		// wait for the running transfer, restart SPI on the other buffer, then drain the filled one
+		while (HAL_SPI_GetState(&_W25QXX_SPI) != HAL_SPI_STATE_READY)
+			;
+		Done = Fill;
+		DoneLen = Len;
+		Len = (NumByteToRead > sizeof(PingPong[0])) ? sizeof(PingPong[0]) : NumByteToRead;
+		if (Len > 0)
+		{
+			Fill ^= 1;
+			HAL_SPI_Receive_DMA(&_W25QXX_SPI, (uint8_t *)PingPong[Fill], Len);
+			NumByteToRead -= Len;
+		}
+		Sink((uint8_t *)PingPong[Done], DoneLen);
+	}
+	HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_SET);
+#if (_W25QXX_DEBUG == 1)
+	printf("w25qxx ReadStreamDMA done after %d ms\r\n", HAL_GetTick() - StartTime);
+#endif
+	W25qxx_ReadUnlock();
+#else
+	W25qxx_ReadStream(ReadAddr, NumByteToRead, Sink);
+#endif
+}
+//###################################################################################################################
+// pixel payloads run in 16 bit frames: half the DR accesses / DMA requests, first byte on the wire lands in bits 15..8
+static void W25qxx_SpiDataSize(uint32_t DataSize, uint32_t DmaMemInc)
+{
+	while (__HAL_SPI_GET_FLAG(&_W25QXX_SPI, SPI_FLAG_BSY))
+		;
+	__HAL_SPI_DISABLE(&_W25QXX_SPI);
+	if (DataSize == SPI_DATASIZE_16BIT)
+		_W25QXX_SPI.Instance->CR1 |= SPI_CR1_DFF;
+	else
+		_W25QXX_SPI.Instance->CR1 &= ~SPI_CR1_DFF;
+	_W25QXX_SPI.Init.DataSize = DataSize;
+#if (_W25QXX_USE_DMA == 1)
+	_W25QXX_SPI.hdmarx->Init.MemInc = DmaMemInc;
+	_W25QXX_SPI.hdmatx->Init.MemInc = DmaMemInc;
+	if (DataSize == SPI_DATASIZE_16BIT)
+	{
+		_W25QXX_SPI.hdmarx->Init.PeriphDataAlignment = DMA_PDATAALIGN_HALFWORD;
+		_W25QXX_SPI.hdmarx->Init.MemDataAlignment = DMA_MDATAALIGN_HALFWORD;
+		_W25QXX_SPI.hdmatx->Init.PeriphDataAlignment = DMA_PDATAALIGN_HALFWORD;
+		_W25QXX_SPI.hdmatx->Init.MemDataAlignment = DMA_MDATAALIGN_HALFWORD;
+	}
+	else
+	{
+		_W25QXX_SPI.hdmarx->Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+		_W25QXX_SPI.hdmarx->Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+		_W25QXX_SPI.hdmatx->Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+		_W25QXX_SPI.hdmatx->Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+	}
+	HAL_DMA_Init(_W25QXX_SPI.hdmarx);
+	HAL_DMA_Init(_W25QXX_SPI.hdmatx);
+#endif
+}
+//###################################################################################################################
+void W25qxx_ReadStreamToPort(uint32_t ReadAddr, volatile uint16_t *Port, uint32_t NumPixelToRead)
+{
+#if (_W25QXX_USE_DMA == 1)
+	static uint16_t Dummy = 0xFFFF;
+#else
+	uint16_t Chunk[_W25QXX_STREAM_CHUNK / 2];
+	uint32_t i;
+#endif
+	uint32_t Len;
+	W25qxx_ReadLock(ReadAddr, NumPixelToRead * 2, false);
+#if (_W25QXX_DEBUG == 1)
+	uint32_t StartTime = HAL_GetTick();
+	printf("w25qxx ReadStreamToPort at Address:%d, %d Pixels  begin...\r\n", ReadAddr, NumPixelToRead);
+#endif
+	HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_RESET);
+	W25qxx_FastReadHeader(ReadAddr);
+#if (_W25QXX_USE_DMA == 1)
+	// both DMA channels parked on a fixed address: SPI DR -> Port with no RAM in between
+	W25qxx_SpiDataSize(SPI_DATASIZE_16BIT, DMA_MINC_DISABLE);
+	while (NumPixelToRead > 0)
+	{
+		Len = (NumPixelToRead > 0xFFFF) ? 0xFFFF : NumPixelToRead;
+		HAL_SPI_TransmitReceive_DMA(&_W25QXX_SPI, (uint8_t *)&Dummy, (uint8_t *)Port, Len);
+		while (HAL_SPI_GetState(&_W25QXX_SPI) != HAL_SPI_STATE_READY)
+			;
+		NumPixelToRead -= Len;
+	}
+#else
+	W25qxx_SpiDataSize(SPI_DATASIZE_16BIT, DMA_MINC_ENABLE);
+	while (NumPixelToRead > 0)
+	{
+		Len = (NumPixelToRead > _W25QXX_STREAM_CHUNK / 2) ? _W25QXX_STREAM_CHUNK / 2 : NumPixelToRead;
+		HAL_SPI_Receive(&_W25QXX_SPI, (uint8_t *)Chunk, Len, 100);
+		for (i = 0; i < Len; i++)
+			*Port = Chunk[i];
+		NumPixelToRead -= Len;
+	}
+#endif
+	W25qxx_SpiDataSize(SPI_DATASIZE_8BIT, DMA_MINC_ENABLE);
+	HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_SET);
+#if (_W25QXX_DEBUG == 1)
+	printf("w25qxx ReadStreamToPort done after %d ms\r\n", HAL_GetTick() - StartTime);
+#endif
+	W25qxx_ReadUnlock();
+}
+//###################################################################################################################
+void W25qxx_ReadPixels(uint16_t *pPixels, uint32_t ReadAddr, uint32_t NumPixelToRead)
+{
+	W25qxx_ReadLock(ReadAddr, NumPixelToRead * 2, false);
+	HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_RESET);
+	W25qxx_FastReadHeader(ReadAddr);
+	W25qxx_SpiDataSize(SPI_DATASIZE_16BIT, DMA_MINC_ENABLE);
+	while (NumPixelToRead > 0)
+	{
+		uint32_t Len = (NumPixelToRead > 0xFFFF) ? 0xFFFF : NumPixelToRead;
+		HAL_SPI_Receive(&_W25QXX_SPI, (uint8_t *)pPixels, Len, 2000);
+		pPixels += Len;
+		NumPixelToRead -= Len;
+	}
+	W25qxx_SpiDataSize(SPI_DATASIZE_8BIT, DMA_MINC_ENABLE);
+	HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_SET);
+	W25qxx_ReadUnlock();
+}
+//###################################################################################################################
+static void W25qxx_StagePage(uint8_t *pStage, const uint8_t *pBuffer, uint32_t Len, bool Swap16)
+{
+	uint32_t i;
+	if (Swap16)
+	{
+		for (i = 0; i < Len; i += 2)
+		{
+			pStage[i] = pBuffer[i + 1];
+			pStage[i + 1] = pBuffer[i];
+		}
+	}
+	else
+	{
+		memcpy(pStage, pBuffer, Len);
+	}
+}
+//###################################################################################################################
+// page programs back to back: while one page programs the next one is staged in the other DMA buffer,
+// and WriteEnable goes out as soon as BUSY drops. Swap16 stores uint16_t data MSB first.
+static bool W25qxx_ProgramStaged(uint32_t WriteAddr, const uint8_t *pBuffer, uint32_t NumByteToWrite, bool Swap16)
+{
+	static uint8_t Stage[2][256];
+	uint32_t Len;
+	uint8_t Cur = 0;
+	bool Ok;
+	W25qxx_Lock();
+#if (_W25QXX_DEBUG == 1)
+	uint32_t StartTime = HAL_GetTick();
+	uint32_t Total = NumByteToWrite;
+	printf("w25qxx Program at Address:%d, %d Bytes  begin...\r\n", WriteAddr, NumByteToWrite);
+#endif
+	W25qxx_CacheInvalidate(WriteAddr, NumByteToWrite);
+	Len = w25qxx.PageSize - (WriteAddr % w25qxx.PageSize);
+	if (Len > NumByteToWrite)
+		Len = NumByteToWrite;
+	W25qxx_StagePage(Stage[Cur], pBuffer, Len, Swap16);
+	Ok = W25qxx_WaitForWriteEnd(_W25QXX_TIMEOUT_PAGE_MS);
+	while (Ok && (Len > 0))
+	{
+		W25qxx_WriteEnable();
+		HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_RESET);
+		W25qxx_SpiAddressCmd(0x02, 0x12, WriteAddr);
+#if (_W25QXX_USE_DMA == 1)
+		HAL_SPI_Transmit_DMA(&_W25QXX_SPI, Stage[Cur], Len);
+		while (HAL_SPI_GetState(&_W25QXX_SPI) != HAL_SPI_STATE_READY)
+			;
+#else
+		HAL_SPI_Transmit(&_W25QXX_SPI, Stage[Cur], Len, 100);
+#endif
+		HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_SET);
+		WriteAddr += Len;
+		pBuffer += Len;
+		NumByteToWrite -= Len;
+		// stage the next page while the chip is busy programming this one
+		Len = (NumByteToWrite > w25qxx.PageSize) ? w25qxx.PageSize : NumByteToWrite;
+		Cur ^= 1;
+		W25qxx_StagePage(Stage[Cur], pBuffer, Len, Swap16);
+		Ok = W25qxx_WaitForWriteEnd(_W25QXX_TIMEOUT_PAGE_MS);
+	}
+#if (_W25QXX_DEBUG == 1)
+	StartTime = HAL_GetTick() - StartTime;
+	printf("w25qxx Program done after %d ms, %d KB/s\r\n", StartTime, StartTime ? Total / StartTime : 0);
+#endif
+	W25qxx_Unlock();
+	return Ok;
+}
+//###################################################################################################################
+bool W25qxx_Program(uint32_t WriteAddr, const uint8_t *pBuffer, uint32_t NumByteToWrite)
+{
+	return W25qxx_ProgramStaged(WriteAddr, pBuffer, NumByteToWrite, false);
+}
+//###################################################################################################################
+bool W25qxx_WritePixels(const uint16_t *pPixels, uint32_t WriteAddr, uint32_t NumPixelToWrite)
+{
+	// same rule as W25qxx_JobSubmit: the byte swap works on halfword aligned pairs
+	if (WriteAddr & 1)
+		return false;
+	return W25qxx_ProgramStaged(WriteAddr, (const uint8_t *)pPixels, NumPixelToWrite * 2, true);
+}
+//###################################################################################################################
+#if (_W25QXX_USE_UPDATE == 1)
+// one sector mirrored in RAM: Update merges into it, Flush writes back only what changed
+static uint32_t W25qxx_UpdateBuf[4096 / 4];
+static uint32_t W25qxx_UpdateSector = 0xFFFFFFFF;
+static uint16_t W25qxx_UpdateDirty;
+static bool W25qxx_UpdateNeedErase;
+//###################################################################################################################
+bool W25qxx_UpdateFlush(void)
+{
+	uint8_t *pSector = (uint8_t *)W25qxx_UpdateBuf;
+	uint32_t Address, Page, First, i;
+	uint16_t Program;
+	if ((W25qxx_UpdateSector == 0xFFFFFFFF) || (W25qxx_UpdateDirty == 0))
+		return true;
+#if (_W25QXX_DEBUG == 1)
+	printf("w25qxx UpdateFlush sector %d, dirty 0x%04X, erase %d\r\n", W25qxx_UpdateSector, W25qxx_UpdateDirty, W25qxx_UpdateNeedErase);
+#endif
+	Address = W25qxx_UpdateSector * w25qxx.SectorSize;
+	Program = W25qxx_UpdateDirty;
+	if (W25qxx_UpdateNeedErase)
+	{
+		// after an erase every page still holding data has to go back, blank ones stay as they are
+		// on a timeout the sector stays dirty so a later flush retries it
+		if (!W25qxx_EraseSector(W25qxx_UpdateSector))
+			return false;
+		Program = 0;
+		for (Page = 0; Page < 16; Page++)
+		{
+			for (i = Page * 64; i < Page * 64 + 64; i++)
+			{
+				if (W25qxx_UpdateBuf[i] != 0xFFFFFFFF)
+				{
+					Program |= 1 << Page;
+					break;
+				}
+			}
+		}
+	}
+	// consecutive pages go out as one pipelined program
+	for (Page = 0; Page < 16;)
+	{
+		if ((Program & (1 << Page)) == 0)
+		{
+			Page++;
+			continue;
+		}
+		First = Page;
+		while ((Page < 16) && (Program & (1 << Page)))
+			Page++;
+		if (!W25qxx_Program(Address + First * 256, &pSector[First * 256], (Page - First) * 256))
+			return false;
+	}
+	W25qxx_UpdateDirty = 0;
+	W25qxx_UpdateNeedErase = false;
+	return true;
+}
+//###################################################################################################################
+bool W25qxx_Update(uint32_t WriteAddr, const uint8_t *pBuffer, uint32_t NumByteToWrite)
+{
+	uint8_t *pSector = (uint8_t *)W25qxx_UpdateBuf;
+	uint32_t Sector, Offset, Len, i;
+	while (NumByteToWrite > 0)
+	{
+		Sector = WriteAddr / w25qxx.SectorSize;
+		Offset = WriteAddr % w25qxx.SectorSize;
+		Len = w25qxx.SectorSize - Offset;
+		if (Len > NumByteToWrite)
+			Len = NumByteToWrite;
+		if (Sector != W25qxx_UpdateSector)
+		{
+			if (!W25qxx_UpdateFlush())
+				return false;
+			W25qxx_ReadBytes(pSector, Sector * w25qxx.SectorSize, w25qxx.SectorSize);
+			W25qxx_UpdateSector = Sector;
+		}
+		for (i = 0; i < Len; i++)
+		{
+			if (pSector[Offset + i] == pBuffer[i])
+				continue;
+			// programming only clears bits, any 0->1 needs the sector erased
+			if ((pSector[Offset + i] & pBuffer[i]) != pBuffer[i])
+				W25qxx_UpdateNeedErase = true;
+			W25qxx_UpdateDirty |= 1 << ((Offset + i) / 256);
+			pSector[Offset + i] = pBuffer[i];
+		}
+		WriteAddr += Len;
+		pBuffer += Len;
+		NumByteToWrite -= Len;
+	}
+	return true;
+}
+//###################################################################################################################
+void W25qxx_UpdateInvalidate(void)
+{
+	W25qxx_UpdateSector = 0xFFFFFFFF;
+	W25qxx_UpdateDirty = 0;
+	W25qxx_UpdateNeedErase = false;
+}
+#endif
+//###################################################################################################################
+bool W25qxx_JobSubmit(W25qxx_Job_t *Job)
+{
+	W25qxx_Job_t *Prev;
+	uint32_t Unit, Capacity, primask;
+	if ((Job == NULL) || (Job->Type > W25QXX_JOB_PROGRAM_PIXELS))
+		return false;
+	if ((Job->Type >= W25QXX_JOB_PROGRAM) && (Job->pBuffer == NULL))
+		return false;
+	if ((Job->Type == W25QXX_JOB_PROGRAM_PIXELS) && ((Job->Address | Job->Len) & 1))
+		return false;
+	// an empty range would still send one erase/program command, a range past the end would wrap to address 0
+	Capacity = w25qxx.CapacityInKiloByte * 1024;
+	if ((Job->Type != W25QXX_JOB_ERASE_CHIP) && ((Job->Len == 0) || (Job->Address >= Capacity) || (Job->Len > Capacity - Job->Address)))
+		return false;
+	if ((Job->Type == W25QXX_JOB_ERASE_SECTOR) || (Job->Type == W25QXX_JOB_ERASE_BLOCK))
+	{
+		// widen the range to whole erase units
+		Unit = (Job->Type == W25QXX_JOB_ERASE_SECTOR) ? w25qxx.SectorSize : w25qxx.BlockSize;
+		Job->Len += Job->Address % Unit;
+		Job->Address -= Job->Address % Unit;
+		Job->Len = ((Job->Len + Unit - 1) / Unit) * Unit;
+	}
+	else if (Job->Type == W25QXX_JOB_ERASE_CHIP)
+	{
+		Job->Address = 0;
+		Job->Len = w25qxx.CapacityInKiloByte * 1024;
+	}
+	if (Job->Priority >= W25QXX_PRIO_COUNT)
+		Job->Priority = W25QXX_PRIO_HOUSEKEEPING;
+	Job->Done = 0;
+	Job->State = W25QXX_JOB_QUEUED;
+	Job->SubmitTime = HAL_GetTick();
+	primask = __get_PRIMASK();
+	__disable_irq();
+	// behind every job of the same or a more urgent class, never in front of the running one
+	if ((W25qxx_JobHead == NULL) || ((W25qxx_JobHead->State != W25QXX_JOB_BUSY) && (W25qxx_JobHead->Priority > Job->Priority)))
+	{
+		Job->Next = W25qxx_JobHead;
+		W25qxx_JobHead = Job;
+	}
+	else
+	{
+		Prev = W25qxx_JobHead;
+		while ((Prev->Next != NULL) && (Prev->Next->Priority <= Job->Priority))
+			Prev = Prev->Next;
+		Job->Next = Prev->Next;
+		Prev->Next = Job;
+	}
+	if (Job->Next == NULL)
+		W25qxx_JobTail = Job;
+	__set_PRIMASK(primask);
+	return true;
+}
+//###################################################################################################################
+bool W25qxx_JobIsFinished(W25qxx_Job_t *Job)
+{
+	return (Job->State == W25QXX_JOB_DONE) || (Job->State == W25QXX_JOB_ERROR);
+}
+//###################################################################################################################
+static void W25qxx_JobFinish(W25qxx_Job_t *Job, W25qxx_JobState_t State)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	W25qxx_JobHead = Job->Next;
+	if (W25qxx_JobHead == NULL)
+		W25qxx_JobTail = NULL;
+	__set_PRIMASK(primask);
+	W25qxx_JobInFlight = false;
+	// pages sharing a 256 byte line with the job range may have been cached by suspend reads meanwhile
+	W25qxx_CacheInvalidate(Job->Address, Job->Len);
+	W25qxx_Unlock();
+	W25qxx_StatsAdd(Job->Priority, (HAL_GetTick() - Job->SubmitTime) * 1000);
+	Job->State = State;
+	if (Job->Callback != NULL)
+		Job->Callback(Job);
+}
+//###################################################################################################################
+static uint32_t W25qxx_JobTimeout(W25qxx_Job_t *Job)
+{
+	switch (Job->Type)
+	{
+	case W25QXX_JOB_ERASE_SECTOR:
+		return _W25QXX_TIMEOUT_SECTOR_MS;
+	case W25QXX_JOB_ERASE_BLOCK:
+		return _W25QXX_TIMEOUT_BLOCK_MS;
+	case W25QXX_JOB_ERASE_CHIP:
+		return _W25QXX_TIMEOUT_CHIP_MS;
+	default:
+		return _W25QXX_TIMEOUT_PAGE_MS;
+	}
+}
+//###################################################################################################################
+void W25qxx_JobProcess(void)
+{
+	static uint8_t Page[256];
+	W25qxx_Job_t *Job = W25qxx_JobHead;
+	uint32_t Address, Len;
+	if ((Job == NULL) || W25qxx_ReadPreempt)
+		return;
+	if (W25qxx_JobInFlight)
+	{
+		if (W25qxx_ReadStatusRegister(1) & 0x01)
+		{
+			// a late step is not abandoned while BUSY: the lock stays until the chip is idle, otherwise
+			// the next job's commands would be ignored by the busy chip and counted as done
+			if (!W25qxx_JobTimedOut && ((HAL_GetTick() - W25qxx_JobStartTime) > W25qxx_JobTimeout(Job)))
+			{
+				W25qxx_JobTimedOut = true;
+				w25qxx.Timeouts++;
+			}
+			return;
+		}
+		W25qxx_JobInFlight = false;
+		if (W25qxx_JobTimedOut)
+		{
+			W25qxx_JobTimedOut = false;
+			W25qxx_JobFinish(Job, W25QXX_JOB_ERROR);
+			return;
+		}
+		if (Job->Done >= Job->Len)
+		{
+			W25qxx_JobFinish(Job, W25QXX_JOB_DONE);
+			return;
+		}
+	}
+	else
+	{
+		// the lock is kept from the first command until the job finishes, waiting reads go first
+		if (W25qxx_ReadWaiting || !W25qxx_TryLock())
+			return;
+		Job->State = W25QXX_JOB_BUSY;
+		W25qxx_CacheInvalidate(Job->Address, Job->Len);
+	}
+	Address = Job->Address + Job->Done;
+	W25qxx_WriteEnable();
+	HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_RESET);
+	switch (Job->Type)
+	{
+	case W25QXX_JOB_ERASE_SECTOR:
+		W25qxx_SpiAddressCmd(0x20, 0x21, Address);
+		Job->Done += w25qxx.SectorSize;
+		break;
+	case W25QXX_JOB_ERASE_BLOCK:
+		W25qxx_SpiAddressCmd(0xD8, 0xDC, Address);
+		Job->Done += w25qxx.BlockSize;
+		break;
+	case W25QXX_JOB_ERASE_CHIP:
+		W25qxx_Spi(0xC7);
+		Job->Done = Job->Len;
+		break;
+	default:
+		Len = w25qxx.PageSize - (Address % w25qxx.PageSize);
+		if (Len > Job->Len - Job->Done)
+			Len = Job->Len - Job->Done;
+		W25qxx_SpiAddressCmd(0x02, 0x12, Address);
+		if (Job->Type == W25QXX_JOB_PROGRAM_PIXELS)
+		{
+			W25qxx_StagePage(Page, &Job->pBuffer[Job->Done], Len, true);
+			W25qxx_SpiWrite(Page, Len);
+		}
+		else
+		{
+			W25qxx_SpiWrite(&Job->pBuffer[Job->Done], Len);
+		}
+		Job->Done += Len;
+		break;
+	}
+	HAL_GPIO_WritePin(_W25QXX_CS_GPIO, _W25QXX_CS_PIN, GPIO_PIN_SET);
+	W25qxx_JobStartTime = HAL_GetTick();
+	W25qxx_JobInFlight = true;
+}
+//###################################################################################################################
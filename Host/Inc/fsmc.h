@@ -0,0 +1,52 @@
+#ifndef __FSMC_H
+#define __FSMC_H
+
+// Host stand-in for the CubeMX fsmc.h: the bank 4 timing registers lcdTuneBusTiming reads and writes,
+// plain memory here. The LCD itself is the GRAM model in lcd_sim.h.
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+	typedef struct
+	{
+		volatile uint32_t BTCR[8];
+
+	} FSMC_Bank1_TypeDef;
+
+	typedef struct
+	{
+		volatile uint32_t BWTR[7];
+
+	} FSMC_Bank1E_TypeDef;
+
+	typedef struct
+	{
+		FSMC_Bank1_TypeDef *Instance;
+		FSMC_Bank1E_TypeDef *Extended;
+
+	} SRAM_HandleTypeDef;
+
+#define FSMC_NORSRAM_BANK4 0x00000006U
+#define FSMC_BTRx_ADDSET_Pos 0U
+#define FSMC_BTRx_ADDSET_Msk (0xFUL << FSMC_BTRx_ADDSET_Pos)
+#define FSMC_BTRx_DATAST_Pos 8U
+#define FSMC_BTRx_DATAST_Msk (0xFFUL << FSMC_BTRx_DATAST_Pos)
+#define FSMC_BWTRx_ADDSET_Pos 0U
+#define FSMC_BWTRx_ADDSET_Msk (0xFUL << FSMC_BWTRx_ADDSET_Pos)
+#define FSMC_BWTRx_DATAST_Pos 8U
+#define FSMC_BWTRx_DATAST_Msk (0xFFUL << FSMC_BWTRx_DATAST_Pos)
+
+#define READ_BIT(REG, BIT) ((REG) & (BIT))
+#define MODIFY_REG(REG, CLEARMASK, SETMASK) ((REG) = (((REG) & (~(CLEARMASK))) | (SETMASK)))
+
+	extern SRAM_HandleTypeDef hsram1;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
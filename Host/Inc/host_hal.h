@@ -0,0 +1,185 @@
+#ifndef _HOST_HAL_H
+#define _HOST_HAL_H
+
+// Stand-in for the CubeMX main.h on a host build: just enough HAL and CMSIS for w25qxx.c and ili9341.c.
+// Force-included by Host/Makefile, the __MAIN_H guard keeps Core/Inc/main.h and the real HAL out.
+#define __MAIN_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+	typedef enum
+	{
+		HAL_OK = 0,
+		HAL_ERROR,
+		HAL_BUSY,
+		HAL_TIMEOUT,
+
+	} HAL_StatusTypeDef;
+
+	//############################################################################
+	// GPIO, only the flash chip select is modelled, the LCD backlight is just a bit
+	//############################################################################
+	typedef enum
+	{
+		GPIO_PIN_RESET = 0,
+		GPIO_PIN_SET,
+
+	} GPIO_PinState;
+
+	typedef struct
+	{
+		volatile uint32_t ODR;
+
+	} GPIO_TypeDef;
+
+	extern GPIO_TypeDef HostGpioB;
+#define GPIOB (&HostGpioB)
+#define GPIO_PIN_0 ((uint16_t)0x0001)
+#define GPIO_PIN_12 ((uint16_t)0x1000)
+#define LCD_BL_Pin GPIO_PIN_0
+#define LCD_BL_GPIO_Port GPIOB
+#define Flash_CS_Pin GPIO_PIN_12
+#define Flash_CS_GPIO_Port GPIOB
+
+	//############################################################################
+	// SPI and its DMA channels, register bits as on the F1
+	//############################################################################
+	typedef struct
+	{
+		volatile uint32_t CR1;
+		volatile uint32_t SR;
+
+	} SPI_TypeDef;
+
+	typedef struct
+	{
+		uint32_t PeriphDataAlignment;
+		uint32_t MemDataAlignment;
+		uint32_t MemInc;
+
+	} DMA_InitTypeDef;
+
+	typedef struct
+	{
+		DMA_InitTypeDef Init;
+
+	} DMA_HandleTypeDef;
+
+	typedef struct
+	{
+		uint32_t DataSize;
+
+	} SPI_InitTypeDef;
+
+	typedef enum
+	{
+		HAL_SPI_STATE_RESET = 0,
+		HAL_SPI_STATE_READY,
+		HAL_SPI_STATE_BUSY,
+		HAL_SPI_STATE_BUSY_TX,
+		HAL_SPI_STATE_BUSY_RX,
+		HAL_SPI_STATE_BUSY_TX_RX,
+
+	} HAL_SPI_StateTypeDef;
+
+	typedef struct
+	{
+		SPI_TypeDef *Instance;
+		SPI_InitTypeDef Init;
+		DMA_HandleTypeDef *hdmatx;
+		DMA_HandleTypeDef *hdmarx;
+		volatile HAL_SPI_StateTypeDef State;
+
+	} SPI_HandleTypeDef;
+
+#define SPI_CR1_SPE 0x0040U
+#define SPI_CR1_DFF 0x0800U
+#define SPI_DATASIZE_8BIT 0x00000000U
+#define SPI_DATASIZE_16BIT SPI_CR1_DFF
+#define SPI_FLAG_BSY 0x0080U
+#define DMA_MINC_ENABLE 0x00000080U
+#define DMA_MINC_DISABLE 0x00000000U
+#define DMA_PDATAALIGN_BYTE 0x00000000U
+#define DMA_PDATAALIGN_HALFWORD 0x00000100U
+#define DMA_MDATAALIGN_BYTE 0x00000000U
+#define DMA_MDATAALIGN_HALFWORD 0x00000400U
+
+#define __HAL_SPI_GET_FLAG(__HANDLE__, __FLAG__) ((((__HANDLE__)->Instance->SR) & (__FLAG__)) == (__FLAG__))
+#define __HAL_SPI_DISABLE(__HANDLE__) ((__HANDLE__)->Instance->CR1 &= ~SPI_CR1_SPE)
+
+	extern SPI_HandleTypeDef hspi2;
+
+	void HAL_GPIO_WritePin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState);
+	HAL_StatusTypeDef HAL_SPI_Transmit(SPI_HandleTypeDef *hspi, uint8_t *pData, uint16_t Size, uint32_t Timeout);
+	HAL_StatusTypeDef HAL_SPI_Receive(SPI_HandleTypeDef *hspi, uint8_t *pData, uint16_t Size, uint32_t Timeout);
+	HAL_StatusTypeDef HAL_SPI_TransmitReceive(SPI_HandleTypeDef *hspi, uint8_t *pTxData, uint8_t *pRxData, uint16_t Size, uint32_t Timeout);
+	HAL_StatusTypeDef HAL_SPI_Transmit_DMA(SPI_HandleTypeDef *hspi, uint8_t *pData, uint16_t Size);
+	HAL_StatusTypeDef HAL_SPI_Receive_DMA(SPI_HandleTypeDef *hspi, uint8_t *pData, uint16_t Size);
+	HAL_StatusTypeDef HAL_SPI_TransmitReceive_DMA(SPI_HandleTypeDef *hspi, uint8_t *pTxData, uint8_t *pRxData, uint16_t Size);
+	HAL_SPI_StateTypeDef HAL_SPI_GetState(SPI_HandleTypeDef *hspi);
+	HAL_StatusTypeDef HAL_DMA_Init(DMA_HandleTypeDef *hdma);
+	extern uint32_t SystemCoreClock;
+	uint32_t HAL_GetTick(void);
+	void HAL_Delay(uint32_t Delay);
+
+	//############################################################################
+	// CMSIS intrinsics. The host is single threaded, "interrupts" are the SysTick
+	// hook of the virtual clock, which is held off while PRIMASK is set.
+	//############################################################################
+#define __LDREXB(ptr) (*(ptr))
+#define __STREXB(value, ptr) ((*(ptr) = (value)), 0U)
+#define __CLREX()
+#define __DMB() __sync_synchronize()
+#define __DSB() __sync_synchronize()
+	uint32_t __get_PRIMASK(void);
+	void __set_PRIMASK(uint32_t priMask);
+	void __disable_irq(void);
+	void __enable_irq(void);
+
+	//############################################################################
+	// Core peripherals behind accessor calls. DWT->CYCCNT follows the virtual clock.
+	// The drivers touch SCB only to set PENDSVSET, so every SCB access pends PendSV
+	// and runs its handler (lcdQueueProcess) right away, __get_IPSR() is 14 meanwhile.
+	//############################################################################
+	typedef struct
+	{
+		volatile uint32_t CTRL;
+		volatile uint32_t CYCCNT;
+
+	} DWT_Type;
+
+	typedef struct
+	{
+		volatile uint32_t DEMCR;
+
+	} CoreDebug_Type;
+
+	typedef struct
+	{
+		volatile uint32_t ICSR;
+
+	} SCB_Type;
+
+#define DWT_CTRL_CYCCNTENA_Msk 0x00000001U
+#define CoreDebug_DEMCR_TRCENA_Msk 0x01000000U
+#define SCB_ICSR_PENDSVSET_Msk 0x10000000U
+#define DWT (HostDwt())
+#define CoreDebug (HostCoreDebug())
+#define SCB (HostScb())
+	DWT_Type *HostDwt(void);
+	CoreDebug_Type *HostCoreDebug(void);
+	SCB_Type *HostScb(void);
+	uint32_t __get_IPSR(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
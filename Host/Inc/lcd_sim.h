@@ -0,0 +1,63 @@
+#ifndef _LCD_SIM_H
+#define _LCD_SIM_H
+
+// ILI9341 GRAM model behind the bus macros of ili9341.h, force-included when Host/Makefile builds ili9341.c.
+// It decodes what the driver relies on: CASET/PASET windows with the write pointer wrapping inside them,
+// RAMWR/RAMWRC pixel writes, RAMRD/RAMRDC reads in the 18 bit R,G,B byte format behind a dummy word,
+// MADCTL MY/MX/MV/BGR, VSCRDEF/VSCRSADD scrolling, SWRESET and READ ID4. Everything else is counted and
+// ignored. GRAM is 240 columns by 320 rows as the controller addresses it, LcdSim_Pixel and the PPM dump
+// show it as the glass does, where GRAM column 0 is on the right.
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define LCD_CmdWrite(command) LcdSim_Cmd(command)
+#define LCD_DataWrite(data) LcdSim_Write(data)
+#define LCD_StatusRead() LcdSim_Status()
+#define LCD_DataRead() LcdSim_Read()
+#define LCD_DataPort (&LcdSim_Port)
+
+#define LCD_SIM_COLUMNS 240
+#define LCD_SIM_ROWS 320
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+	typedef struct
+	{
+		uint32_t Commands; // words written with RS low
+		uint32_t Params;   // data words written after any command but RAMWR/RAMWRC
+		uint32_t Pixels;   // data words written into GRAM
+		uint32_t Reads;	   // data words read back, dummy reads included
+		uint32_t Outside;  // pixels whose address fell outside the 240x320 GRAM, always a driver bug
+
+	} LcdSim_Counts_t;
+
+	extern LcdSim_Counts_t LcdSim_Counts;
+	// the LCD data register as DMA sees it, NorModel_SetPort(&LcdSim_Port, LcdSim_Write) routes flash streams
+	extern volatile uint16_t LcdSim_Port;
+
+	// power on state, GRAM filled with Color, counters cleared
+	void LcdSim_Init(uint16_t Color);
+	void LcdSim_Cmd(uint16_t Command);
+	void LcdSim_Write(uint16_t Data);
+	uint16_t LcdSim_Read(void);
+	uint16_t LcdSim_Status(void);
+
+	// returns the counters and clears them, call around a driver call to get its bus words
+	LcdSim_Counts_t LcdSim_CountsTake(void);
+	uint8_t LcdSim_Madctl(void);
+	// GRAM as addressed with MADCTL = 0
+	uint16_t LcdSim_Gram(uint16_t Column, uint16_t Row);
+	// what the glass shows at (x, y), portrait with the flex at the bottom, vertical scroll applied
+	uint16_t LcdSim_Pixel(uint16_t x, uint16_t y);
+	// LcdSim_Pixel for the whole glass as a binary PPM, RGB565 words shown as RGB when MADCTL has BGR set
+	bool LcdSim_DumpPpm(const char *Path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef _LCD_TRACE_H
+#define _LCD_TRACE_H
+
+// Replays the bus traces of lcdTraceStart/lcdTraceFrame/lcdTraceStop (token format in ili9341.h) into the
+// GRAM model of lcd_sim.h. A trace file holds the words of lcdTraceStop as they sit in target RAM, little
+// endian, e.g. from gdb: dump binary memory lcd.trace buf buf+2*words.
+
+#include "lcd_sim.h"
+
+#define LCD_TRACE_TAIL 0xFFFFFFFFU
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+	typedef struct
+	{
+		uint32_t Number;   // n of the closing 0x8000 marker, LCD_TRACE_TAIL for words after the last one
+		uint32_t Tokens;   // trace words the frame took
+		uint32_t Windows;  // RAMWR/RAMWRC commands
+		LcdSim_Counts_t Bus; // bus words the frame expands to
+
+	} LcdTrace_Frame_t;
+
+	// whole file in a malloc'ed buffer, NULL when it can not be read or has an odd length
+	uint16_t *LcdTrace_Load(const char *Path, uint32_t *Words);
+	bool LcdTrace_Save(const char *Path, const uint16_t *Trace, uint32_t Words);
+	// feeds Trace to the model as it stands, OnFrame (may be NULL) gets every frame once its marker or the
+	// end of the trace is reached. Returns the index of the first malformed token, Words when all is well.
+	uint32_t LcdTrace_Replay(const uint16_t *Trace, uint32_t Words,
+							 void (*OnFrame)(const LcdTrace_Frame_t *Frame, void *Arg), void *Arg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,85 @@
+#ifndef _NOR_MODEL_H
+#define _NOR_MODEL_H
+
+// In-memory Winbond style SPI NOR behind HAL_SPI_*, HAL_GPIO_WritePin (flash CS), HAL_GetTick and HAL_Delay,
+// on a virtual clock. It keeps the rules the real chip has: programming only clears bits and wraps inside
+// its 256 byte page, program/erase need WEL and leave BUSY set for tPP/tSE/tBE/tCE, commands other than
+// status reads and suspend are ignored while BUSY, the suspended range can not be read. Every broken rule
+// is counted in NorModel_Stats.Violations with the reason in NorModel_LastViolation.
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+	// typical datasheet times in us
+	typedef struct
+	{
+		uint32_t PageProgram;
+		uint32_t Sector;
+		uint32_t Block32;
+		uint32_t Block64;
+		uint32_t Chip;
+		uint32_t Suspend; // tSUS, BUSY drops this long after 0x75
+
+	} NorModel_Timing_t;
+
+	// what 0x5A returns: a JESD216B header and basic flash parameter table for the model's size, with
+	// erase types 4K/32K/64K under EraseOpcode and times from NorModel_Timing. The opcodes only change
+	// the table, erases still go by 0x20/0x52/0xD8. Without Present the chip reads 0xFF, as old parts do.
+	typedef struct
+	{
+		bool Present;
+		uint8_t EraseOpcode[3];
+
+	} NorModel_Sfdp_t;
+
+	typedef struct
+	{
+		uint32_t Violations;
+		uint32_t BitsRaised; // program data asked for a 0 -> 1 change, the array kept the 0
+		uint32_t PageWraps;	 // page program data ran past the end of its page and wrapped to the start
+		uint32_t Programs;
+		uint32_t Erases;
+		uint32_t Suspends;
+		uint32_t Resumes;
+		uint64_t BusyNs; // total time spent programming or erasing
+		uint32_t Commands[256]; // transactions by opcode, ignored ones included
+
+	} NorModel_Stats_t;
+
+	extern NorModel_Timing_t NorModel_Timing;
+	extern NorModel_Sfdp_t NorModel_Sfdp;
+	extern NorModel_Stats_t NorModel_Stats;
+	extern const char *NorModel_LastViolation;
+
+	// fresh erased chip of SizeInKiloByte (128..65536, power of 2) at time 0, default Winbond timings and SFDP
+	void NorModel_Init(uint32_t SizeInKiloByte);
+	uint8_t *NorModel_Array(void);
+	uint32_t NorModel_Size(void);
+
+	// virtual clock, 72 MHz CPU and 18 MHz SPI as SPI2 on the board
+	uint64_t NorModel_Now(void);
+	void NorModel_Advance(uint64_t Ns);
+	uint32_t NorModel_Cycles(void);
+	// called on every 1 ms tick while "interrupts" are enabled, the host side of SysTick
+	void NorModel_SetTickHook(void (*Hook)(void));
+
+	// frames an rx DMA without memory increment stores at Port are also handed to Write, the way
+	// W25qxx_ReadStreamToPort feeds the LCD data register
+	void NorModel_SetPort(volatile uint16_t *Port, void (*Write)(uint16_t Data));
+
+	// true while program/erase runs or is suspended
+	bool NorModel_IsBusy(void);
+	bool NorModel_IsSuspended(void);
+	// true while a DMA transfer in flight still has to write into [pData, pData + Len)
+	bool NorModel_DmaTargets(const void *pData, uint32_t Len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,9 @@
+#ifndef _HOST_W25QXXCONFIG_H
+#define _HOST_W25QXXCONFIG_H
+
+// the board configuration, except that every byte goes through HAL_SPI_*, which the flash model backs.
+// -IInc comes first, so the board file is included by path.
+#define _W25QXX_USE_LL                0
+#include "../../Core/Inc/w25qxxConf.h"
+
+#endif
@@ -0,0 +1,33 @@
+// What ili9341.c needs from the Cortex-M3 core and the FSMC beyond the LCD bus macros: PendSV, which runs
+// the render queue, and the bank 4 timing registers.
+#include "host_hal.h"
+#include "fsmc.h"
+#include "ili9341.h"
+
+static SCB_Type HostScbRegs;
+static bool HostPendSv;
+static bool HostInPendSv;
+static FSMC_Bank1_TypeDef HostFsmcBank1;
+static FSMC_Bank1E_TypeDef HostFsmcBank1E;
+SRAM_HandleTypeDef hsram1 = {&HostFsmcBank1, &HostFsmcBank1E};
+//###################################################################################################################
+// PendSV has the lowest priority, a pend from inside the handler runs it again once it returns
+SCB_Type *HostScb(void)
+{
+	HostPendSv = true;
+	if (HostInPendSv)
+		return &HostScbRegs;
+	HostInPendSv = true;
+	while (HostPendSv)
+	{
+		HostPendSv = false;
+		lcdQueueProcess();
+	}
+	HostInPendSv = false;
+	return &HostScbRegs;
+}
+//###################################################################################################################
+uint32_t __get_IPSR(void)
+{
+	return HostInPendSv ? 14 : 0;
+}
@@ -0,0 +1,294 @@
+#include "host_hal.h"
+#include "lcd_sim.h"
+#include <stdio.h>
+#include <string.h>
+
+#define LCD_SIM_SWRESET 0x01
+#define LCD_SIM_CASET 0x2A
+#define LCD_SIM_PASET 0x2B
+#define LCD_SIM_RAMWR 0x2C
+#define LCD_SIM_RAMRD 0x2E
+#define LCD_SIM_VSCRDEF 0x33
+#define LCD_SIM_MADCTL 0x36
+#define LCD_SIM_VSCRSADD 0x37
+#define LCD_SIM_RAMWRC 0x3C
+#define LCD_SIM_RAMRDC 0x3E
+#define LCD_SIM_RDID4 0xD3
+
+#define LCD_SIM_MY 0x80
+#define LCD_SIM_MX 0x40
+#define LCD_SIM_MV 0x20
+#define LCD_SIM_BGR 0x08
+
+typedef struct
+{
+	uint16_t Gram[LCD_SIM_ROWS][LCD_SIM_COLUMNS];
+	// command in progress and its parameters so far
+	uint8_t Cmd;
+	uint8_t Param[6];
+	uint32_t ParamCount;
+	// window and pointer, in the MCU view that MADCTL maps onto GRAM
+	uint16_t StartColumn;
+	uint16_t EndColumn;
+	uint16_t StartPage;
+	uint16_t EndPage;
+	uint16_t Column;
+	uint16_t Page;
+	// RAMRD: dummy word pending, R,G,B bytes of the pixel being read
+	bool ReadDummy;
+	uint8_t ReadRgb[3];
+	uint8_t ReadLeft;
+	uint8_t Madctl;
+	uint16_t TopFixed;
+	uint16_t ScrollArea;
+	uint16_t BottomFixed;
+	uint16_t ScrollStart;
+
+} LcdSim_t;
+
+LcdSim_Counts_t LcdSim_Counts;
+volatile uint16_t LcdSim_Port;
+
+static LcdSim_t Sim;
+//###################################################################################################################
+static void LcdSim_Reset(void)
+{
+	Sim.Cmd = 0;
+	Sim.ParamCount = 0;
+	Sim.StartColumn = 0;
+	Sim.EndColumn = LCD_SIM_COLUMNS - 1;
+	Sim.StartPage = 0;
+	Sim.EndPage = LCD_SIM_ROWS - 1;
+	Sim.Column = 0;
+	Sim.Page = 0;
+	Sim.ReadDummy = false;
+	Sim.ReadLeft = 0;
+	Sim.Madctl = 0;
+	Sim.TopFixed = 0;
+	Sim.ScrollArea = LCD_SIM_ROWS;
+	Sim.BottomFixed = 0;
+	Sim.ScrollStart = 0;
+}
+//###################################################################################################################
+void LcdSim_Init(uint16_t Color)
+{
+	uint32_t Row, Column;
+	for (Row = 0; Row < LCD_SIM_ROWS; Row++)
+		for (Column = 0; Column < LCD_SIM_COLUMNS; Column++)
+			Sim.Gram[Row][Column] = Color;
+	LcdSim_Reset();
+	memset(&LcdSim_Counts, 0, sizeof(LcdSim_Counts));
+}
+//###################################################################################################################
+// MV exchanges the MCU column and page, then MX mirrors the GRAM column and MY the GRAM row
+static uint16_t *LcdSim_Cell(void)
+{
+	uint16_t Column = Sim.Column;
+	uint16_t Row = Sim.Page;
+	if (Sim.Madctl & LCD_SIM_MV)
+	{
+		Column = Sim.Page;
+		Row = Sim.Column;
+	}
+	if ((Column >= LCD_SIM_COLUMNS) || (Row >= LCD_SIM_ROWS))
+		return NULL;
+	if (Sim.Madctl & LCD_SIM_MX)
+		Column = LCD_SIM_COLUMNS - 1 - Column;
+	if (Sim.Madctl & LCD_SIM_MY)
+		Row = LCD_SIM_ROWS - 1 - Row;
+	return &Sim.Gram[Row][Column];
+}
+//###################################################################################################################
+// the pointer runs along the column range, then steps the page and wraps back to the window start
+static void LcdSim_Step(void)
+{
+	if (Sim.Column++ < Sim.EndColumn)
+		return;
+	Sim.Column = Sim.StartColumn;
+	if (Sim.Page++ < Sim.EndPage)
+		return;
+	Sim.Page = Sim.StartPage;
+}
+//###################################################################################################################
+static void LcdSim_Param(uint16_t Data)
+{
+	LcdSim_Counts.Params++;
+	if (Sim.ParamCount < sizeof(Sim.Param))
+		Sim.Param[Sim.ParamCount] = (uint8_t)Data;
+	Sim.ParamCount++;
+	switch (Sim.Cmd)
+	{
+	case LCD_SIM_CASET:
+		if (Sim.ParamCount != 4)
+			break;
+		Sim.StartColumn = (Sim.Param[0] << 8) | Sim.Param[1];
+		Sim.EndColumn = (Sim.Param[2] << 8) | Sim.Param[3];
+		break;
+	case LCD_SIM_PASET:
+		if (Sim.ParamCount != 4)
+			break;
+		Sim.StartPage = (Sim.Param[0] << 8) | Sim.Param[1];
+		Sim.EndPage = (Sim.Param[2] << 8) | Sim.Param[3];
+		break;
+	case LCD_SIM_MADCTL:
+		if (Sim.ParamCount == 1)
+			Sim.Madctl = Sim.Param[0];
+		break;
+	case LCD_SIM_VSCRDEF:
+		if (Sim.ParamCount != 6)
+			break;
+		Sim.TopFixed = (Sim.Param[0] << 8) | Sim.Param[1];
+		Sim.ScrollArea = (Sim.Param[2] << 8) | Sim.Param[3];
+		Sim.BottomFixed = (Sim.Param[4] << 8) | Sim.Param[5];
+		break;
+	case LCD_SIM_VSCRSADD:
+		if (Sim.ParamCount == 2)
+			Sim.ScrollStart = (Sim.Param[0] << 8) | Sim.Param[1];
+		break;
+	}
+}
+//###################################################################################################################
+void LcdSim_Cmd(uint16_t Command)
+{
+	LcdSim_Counts.Commands++;
+	Sim.Cmd = (uint8_t)Command;
+	Sim.ParamCount = 0;
+	switch (Sim.Cmd)
+	{
+	case LCD_SIM_SWRESET:
+		LcdSim_Reset();
+		break;
+	case LCD_SIM_RAMWR:
+	case LCD_SIM_RAMRD:
+		Sim.Column = Sim.StartColumn;
+		Sim.Page = Sim.StartPage;
+		Sim.ReadDummy = true;
+		Sim.ReadLeft = 0;
+		break;
+	case LCD_SIM_RAMRDC:
+		Sim.ReadDummy = true;
+		Sim.ReadLeft = 0;
+		break;
+	}
+}
+//###################################################################################################################
+void LcdSim_Write(uint16_t Data)
+{
+	uint16_t *Cell;
+	if ((Sim.Cmd != LCD_SIM_RAMWR) && (Sim.Cmd != LCD_SIM_RAMWRC))
+	{
+		LcdSim_Param(Data);
+		return;
+	}
+	LcdSim_Counts.Pixels++;
+	Cell = LcdSim_Cell();
+	if (Cell)
+		*Cell = Data;
+	else
+		LcdSim_Counts.Outside++;
+	LcdSim_Step();
+}
+//###################################################################################################################
+static uint8_t LcdSim_ReadByte(void)
+{
+	uint16_t *Cell;
+	uint16_t Color;
+	if (Sim.ReadLeft == 0)
+	{
+		Cell = LcdSim_Cell();
+		Color = Cell ? *Cell : 0;
+		Sim.ReadRgb[0] = (Color >> 8) & 0xF8;
+		Sim.ReadRgb[1] = (Color >> 3) & 0xFC;
+		Sim.ReadRgb[2] = (Color << 3) & 0xF8;
+		Sim.ReadLeft = 3;
+		LcdSim_Step();
+	}
+	return Sim.ReadRgb[3 - Sim.ReadLeft--];
+}
+//###################################################################################################################
+uint16_t LcdSim_Read(void)
+{
+	static const uint8_t Id4[] = {0x00, 0x00, 0x93, 0x41};
+	uint16_t Data;
+	LcdSim_Counts.Reads++;
+	switch (Sim.Cmd)
+	{
+	case LCD_SIM_RAMRD:
+	case LCD_SIM_RAMRDC:
+		if (Sim.ReadDummy)
+		{
+			Sim.ReadDummy = false;
+			return 0;
+		}
+		Data = LcdSim_ReadByte() << 8;
+		return Data | LcdSim_ReadByte();
+	case LCD_SIM_RDID4:
+		Data = (Sim.ParamCount < sizeof(Id4)) ? Id4[Sim.ParamCount] : 0;
+		Sim.ParamCount++;
+		return Data;
+	default:
+		return 0;
+	}
+}
+//###################################################################################################################
+uint16_t LcdSim_Status(void)
+{
+	return 0;
+}
+//###################################################################################################################
+LcdSim_Counts_t LcdSim_CountsTake(void)
+{
+	LcdSim_Counts_t Counts = LcdSim_Counts;
+	memset(&LcdSim_Counts, 0, sizeof(LcdSim_Counts));
+	return Counts;
+}
+//###################################################################################################################
+uint8_t LcdSim_Madctl(void)
+{
+	return Sim.Madctl;
+}
+//###################################################################################################################
+uint16_t LcdSim_Gram(uint16_t Column, uint16_t Row)
+{
+	if ((Column >= LCD_SIM_COLUMNS) || (Row >= LCD_SIM_ROWS))
+		return 0;
+	return Sim.Gram[Row][Column];
+}
+//###################################################################################################################
+uint16_t LcdSim_Pixel(uint16_t x, uint16_t y)
+{
+	uint16_t Row = y;
+	if ((x >= LCD_SIM_COLUMNS) || (y >= LCD_SIM_ROWS))
+		return 0;
+	// the scroll area shows GRAM from ScrollStart on, a definition that does not add up to 320 lines is ignored
+	if ((Sim.TopFixed + Sim.ScrollArea + Sim.BottomFixed == LCD_SIM_ROWS) && (Sim.ScrollArea > 0) &&
+		(y >= Sim.TopFixed) && (y < Sim.TopFixed + Sim.ScrollArea) &&
+		(Sim.ScrollStart >= Sim.TopFixed) && (Sim.ScrollStart < Sim.TopFixed + Sim.ScrollArea))
+		Row = Sim.TopFixed + (Sim.ScrollStart - Sim.TopFixed + y - Sim.TopFixed) % Sim.ScrollArea;
+	return Sim.Gram[Row][LCD_SIM_COLUMNS - 1 - x];
+}
+//###################################################################################################################
+bool LcdSim_DumpPpm(const char *Path)
+{
+	FILE *f = fopen(Path, "wb");
+	uint16_t x, y, Color;
+	uint8_t Rgb[3], Red, Blue;
+	if (f == NULL)
+		return false;
+	fprintf(f, "P6\n%u %u\n255\n", LCD_SIM_COLUMNS, LCD_SIM_ROWS);
+	for (y = 0; y < LCD_SIM_ROWS; y++)
+	{
+		for (x = 0; x < LCD_SIM_COLUMNS; x++)
+		{
+			Color = LcdSim_Pixel(x, y);
+			Red = ((Color >> 11) & 0x1F) * 255 / 31;
+			Blue = (Color & 0x1F) * 255 / 31;
+			// the glass has BGR stripes, without the BGR bit red and blue come out swapped
+			Rgb[0] = (Sim.Madctl & LCD_SIM_BGR) ? Red : Blue;
+			Rgb[1] = ((Color >> 5) & 0x3F) * 255 / 63;
+			Rgb[2] = (Sim.Madctl & LCD_SIM_BGR) ? Blue : Red;
+			fwrite(Rgb, 1, 3, f);
+		}
+	}
+	return fclose(f) == 0;
+}
@@ -0,0 +1,109 @@
+#include "host_hal.h"
+#include "lcd_trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LCD_TRACE_RAMWR 0x2C
+#define LCD_TRACE_RAMWRC 0x3C
+
+//###################################################################################################################
+uint16_t *LcdTrace_Load(const char *Path, uint32_t *Words)
+{
+	FILE *f = fopen(Path, "rb");
+	uint16_t *Trace = NULL;
+	uint8_t *Bytes;
+	long Size;
+	uint32_t i;
+	if (f == NULL)
+		return NULL;
+	if ((fseek(f, 0, SEEK_END) == 0) && ((Size = ftell(f)) >= 0) && ((Size & 1) == 0) && (fseek(f, 0, SEEK_SET) == 0))
+	{
+		Trace = malloc(Size + 2);
+		Bytes = (uint8_t *)Trace;
+		if (fread(Bytes, 1, Size, f) == (size_t)Size)
+		{
+			*Words = Size / 2;
+			for (i = 0; i < *Words; i++)
+				Trace[i] = Bytes[2 * i] | (Bytes[2 * i + 1] << 8);
+		}
+		else
+		{
+			free(Trace);
+			Trace = NULL;
+		}
+	}
+	fclose(f);
+	return Trace;
+}
+//###################################################################################################################
+bool LcdTrace_Save(const char *Path, const uint16_t *Trace, uint32_t Words)
+{
+	FILE *f = fopen(Path, "wb");
+	uint8_t Bytes[2];
+	uint32_t i;
+	if (f == NULL)
+		return false;
+	for (i = 0; i < Words; i++)
+	{
+		Bytes[0] = Trace[i] & 0xFF;
+		Bytes[1] = Trace[i] >> 8;
+		fwrite(Bytes, 1, 2, f);
+	}
+	return fclose(f) == 0;
+}
+//###################################################################################################################
+static void LcdTrace_Close(LcdTrace_Frame_t *Frame, uint32_t Number, void (*OnFrame)(const LcdTrace_Frame_t *, void *), void *Arg)
+{
+	Frame->Number = Number;
+	Frame->Bus = LcdSim_CountsTake();
+	if (OnFrame)
+		OnFrame(Frame, Arg);
+	memset(Frame, 0, sizeof(*Frame));
+}
+//###################################################################################################################
+uint32_t LcdTrace_Replay(const uint16_t *Trace, uint32_t Words,
+						 void (*OnFrame)(const LcdTrace_Frame_t *Frame, void *Arg), void *Arg)
+{
+	LcdTrace_Frame_t Frame;
+	uint32_t i = 0, Start, n;
+	memset(&Frame, 0, sizeof(Frame));
+	LcdSim_CountsTake();
+	while (i < Words)
+	{
+		Start = i;
+		n = Trace[i] & 0x3FFF;
+		switch (Trace[i] & 0xC000)
+		{
+		case 0x0000:
+			if (n > 0xFF)
+				return Start;
+			LcdSim_Cmd(n);
+			Frame.Windows += (n == LCD_TRACE_RAMWR) || (n == LCD_TRACE_RAMWRC);
+			i++;
+			break;
+		case 0x4000:
+			if ((n < 2) || (i + 1 >= Words))
+				return Start;
+			while (n--)
+				LcdSim_Write(Trace[i + 1]);
+			i += 2;
+			break;
+		case 0x8000:
+			Frame.Tokens++;
+			LcdTrace_Close(&Frame, n, OnFrame, Arg);
+			i++;
+			continue;
+		default:
+			if ((n == 0) || (i + 1 + n > Words))
+				return Start;
+			for (i++; n--; i++)
+				LcdSim_Write(Trace[i]);
+			break;
+		}
+		Frame.Tokens += i - Start;
+	}
+	if (Frame.Tokens)
+		LcdTrace_Close(&Frame, LCD_TRACE_TAIL, OnFrame, Arg);
+	return Words;
+}
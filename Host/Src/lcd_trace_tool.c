@@ -0,0 +1,201 @@
+// Host tool for LCD bus traces, see lcd_trace.h for the file format.
+//   lcd_trace report TRACE          bus words per frame, command words against pixel words
+//   lcd_trace replay TRACE OUT.ppm  draws TRACE on a GRAM model from reset and dumps the glass
+//   lcd_trace diff A B              per frame word deltas, the first token that differs, GRAM pixels that differ
+// Exit code 0 on success, for diff only when both traces leave the same picture.
+#include "host_hal.h"
+#include "lcd_trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct
+{
+	LcdTrace_Frame_t *Frame;
+	uint32_t Count;
+
+} FrameList_t;
+
+static uint16_t GramA[LCD_SIM_ROWS][LCD_SIM_COLUMNS];
+static uint16_t GramB[LCD_SIM_ROWS][LCD_SIM_COLUMNS];
+
+//###################################################################################################################
+static void FrameName(const LcdTrace_Frame_t *Frame, char *Name)
+{
+	if (Frame->Number == LCD_TRACE_TAIL)
+		strcpy(Name, "tail");
+	else
+		sprintf(Name, "%u", (unsigned)Frame->Number);
+}
+//###################################################################################################################
+static double Overhead(const LcdSim_Counts_t *Bus)
+{
+	uint32_t Total = Bus->Commands + Bus->Params + Bus->Pixels;
+	return Total ? 100.0 * (Bus->Commands + Bus->Params) / Total : 0.0;
+}
+//###################################################################################################################
+static void PrintFrame(const LcdTrace_Frame_t *Frame, void *Arg)
+{
+	LcdSim_Counts_t *Sum = Arg;
+	char Name[12];
+	FrameName(Frame, Name);
+	printf("%6s %8u %8u %8u %9u %7u %7.1f%%\n", Name, Frame->Tokens, Frame->Bus.Commands, Frame->Bus.Params,
+		   Frame->Bus.Pixels, Frame->Windows, Overhead(&Frame->Bus));
+	Sum->Commands += Frame->Bus.Commands;
+	Sum->Params += Frame->Bus.Params;
+	Sum->Pixels += Frame->Bus.Pixels;
+	Sum->Outside += Frame->Bus.Outside;
+}
+//###################################################################################################################
+static void AddFrame(const LcdTrace_Frame_t *Frame, void *Arg)
+{
+	FrameList_t *List = Arg;
+	List->Frame = realloc(List->Frame, (List->Count + 1) * sizeof(*Frame));
+	List->Frame[List->Count++] = *Frame;
+}
+//###################################################################################################################
+static uint16_t *Load(const char *Path, uint32_t *Words)
+{
+	uint16_t *Trace = LcdTrace_Load(Path, Words);
+	if (Trace == NULL)
+		fprintf(stderr, "lcd_trace: can not read %s\n", Path);
+	return Trace;
+}
+//###################################################################################################################
+static bool Replay(const char *Path, const uint16_t *Trace, uint32_t Words,
+				   void (*OnFrame)(const LcdTrace_Frame_t *Frame, void *Arg), void *Arg)
+{
+	uint32_t Bad;
+	LcdSim_Init(0x0000);
+	Bad = LcdTrace_Replay(Trace, Words, OnFrame, Arg);
+	if (Bad == Words)
+		return true;
+	fprintf(stderr, "lcd_trace: %s: malformed token 0x%04X at word %u\n", Path, Trace[Bad], (unsigned)Bad);
+	return false;
+}
+//###################################################################################################################
+static void Snapshot(uint16_t Gram[LCD_SIM_ROWS][LCD_SIM_COLUMNS])
+{
+	uint16_t Row, Column;
+	for (Row = 0; Row < LCD_SIM_ROWS; Row++)
+		for (Column = 0; Column < LCD_SIM_COLUMNS; Column++)
+			Gram[Row][Column] = LcdSim_Gram(Column, Row);
+}
+//###################################################################################################################
+static int Report(const char *Path)
+{
+	LcdSim_Counts_t Sum;
+	uint16_t *Trace;
+	uint32_t Words;
+	bool Ok;
+	if ((Trace = Load(Path, &Words)) == NULL)
+		return 1;
+	memset(&Sum, 0, sizeof(Sum));
+	printf("%s: %u trace words\n", Path, (unsigned)Words);
+	printf(" frame   tokens commands   params    pixels windows overhead\n");
+	Ok = Replay(Path, Trace, Words, PrintFrame, &Sum);
+	printf("   all %8u %8u %8u %9u         %7.1f%%\n", (unsigned)Words, Sum.Commands, Sum.Params, Sum.Pixels,
+		   Overhead(&Sum));
+	if (Sum.Outside)
+		printf("%u pixels addressed outside GRAM\n", Sum.Outside);
+	free(Trace);
+	return Ok ? 0 : 1;
+}
+//###################################################################################################################
+static int ReplayToPpm(const char *Path, const char *Out)
+{
+	uint16_t *Trace;
+	uint32_t Words;
+	bool Ok;
+	if ((Trace = Load(Path, &Words)) == NULL)
+		return 1;
+	Ok = Replay(Path, Trace, Words, NULL, NULL);
+	if (Ok && !LcdSim_DumpPpm(Out))
+	{
+		fprintf(stderr, "lcd_trace: can not write %s\n", Out);
+		Ok = false;
+	}
+	free(Trace);
+	return Ok ? 0 : 1;
+}
+//###################################################################################################################
+static int Diff(const char *PathA, const char *PathB)
+{
+	FrameList_t A = {NULL, 0}, B = {NULL, 0};
+	uint16_t *TraceA, *TraceB;
+	uint32_t WordsA, WordsB, i, Pixels = 0;
+	uint16_t Row, Column, Left = LCD_SIM_COLUMNS, Right = 0, Top = LCD_SIM_ROWS, Bottom = 0;
+	const LcdTrace_Frame_t *Fa, *Fb;
+	char Name[12];
+	bool Ok;
+	TraceA = Load(PathA, &WordsA);
+	TraceB = Load(PathB, &WordsB);
+	if ((TraceA == NULL) || (TraceB == NULL))
+		return 1;
+	Ok = Replay(PathA, TraceA, WordsA, AddFrame, &A);
+	Snapshot(GramA);
+	Ok = Replay(PathB, TraceB, WordsB, AddFrame, &B) && Ok;
+	Snapshot(GramB);
+
+	printf("%s: %u trace words, %s: %u trace words\n", PathA, (unsigned)WordsA, PathB, (unsigned)WordsB);
+	for (i = 0; (i < WordsA) && (i < WordsB) && (TraceA[i] == TraceB[i]); i++)
+		;
+	if ((i == WordsA) && (i == WordsB))
+		printf("traces are identical\n");
+	else
+		printf("first difference at word %u\n", (unsigned)i);
+
+	printf(" frame  commands+params A/B        pixels A/B      overhead A/B\n");
+	for (i = 0; (i < A.Count) || (i < B.Count); i++)
+	{
+		Fa = (i < A.Count) ? &A.Frame[i] : NULL;
+		Fb = (i < B.Count) ? &B.Frame[i] : NULL;
+		FrameName(Fa ? Fa : Fb, Name);
+		if ((Fa == NULL) || (Fb == NULL))
+		{
+			printf("%6s only in %s\n", Name, Fa ? PathA : PathB);
+			continue;
+		}
+		printf("%6s %8u %8u %+7d %8u %8u %6.1f%% %6.1f%%\n", Name, Fa->Bus.Commands + Fa->Bus.Params,
+			   Fb->Bus.Commands + Fb->Bus.Params,
+			   (int)(Fb->Bus.Commands + Fb->Bus.Params) - (int)(Fa->Bus.Commands + Fa->Bus.Params),
+			   Fa->Bus.Pixels, Fb->Bus.Pixels, Overhead(&Fa->Bus), Overhead(&Fb->Bus));
+	}
+
+	for (Row = 0; Row < LCD_SIM_ROWS; Row++)
+	{
+		for (Column = 0; Column < LCD_SIM_COLUMNS; Column++)
+		{
+			if (GramA[Row][Column] == GramB[Row][Column])
+				continue;
+			Pixels++;
+			Left = (Column < Left) ? Column : Left;
+			Right = (Column > Right) ? Column : Right;
+			Top = (Row < Top) ? Row : Top;
+			Bottom = (Row > Bottom) ? Row : Bottom;
+		}
+	}
+	if (Pixels)
+		printf("GRAM differs in %u pixels, columns %u..%u, rows %u..%u\n", (unsigned)Pixels, Left, Right, Top, Bottom);
+	else
+		printf("GRAM is the same\n");
+	free(A.Frame);
+	free(B.Frame);
+	free(TraceA);
+	free(TraceB);
+	return (Ok && (Pixels == 0)) ? 0 : 1;
+}
+//###################################################################################################################
+int main(int argc, char **argv)
+{
+	if ((argc == 3) && (strcmp(argv[1], "report") == 0))
+		return Report(argv[2]);
+	if ((argc == 4) && (strcmp(argv[1], "replay") == 0))
+		return ReplayToPpm(argv[2], argv[3]);
+	if ((argc == 4) && (strcmp(argv[1], "diff") == 0))
+		return Diff(argv[2], argv[3]);
+	fprintf(stderr, "usage: lcd_trace report TRACE\n"
+					"       lcd_trace replay TRACE OUT.ppm\n"
+					"       lcd_trace diff A B\n");
+	return 2;
+}
@@ -0,0 +1,685 @@
+#include "host_hal.h"
+#include "nor_model.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define NOR_CPU_HZ 72000000ULL
+#define NOR_SPI_BYTE_NS 444ULL // 8 bits at 18 MHz
+#define NOR_CALL_NS 50ULL	   // cost of a cycle counter read or a GPIO write
+#define NOR_TICK_NS 1000000ULL
+
+typedef enum
+{
+	NOR_OP_NONE = 0,
+	NOR_OP_PROGRAM,
+	NOR_OP_ERASE,
+
+} NorModel_Op_t;
+
+typedef struct
+{
+	uint8_t *Mem;
+	uint32_t Size;
+	uint64_t Now;
+	// current transaction
+	bool Selected;
+	uint32_t Count;
+	uint8_t Cmd;
+	uint32_t Addr;
+	bool Ignored;
+	uint8_t Page[256];
+	uint32_t PageBytes;
+	// write enable latch and the program/erase in the array
+	bool Wel;
+	NorModel_Op_t Op;
+	uint32_t OpAddr;
+	uint32_t OpLen;
+	uint8_t OpPage[256];
+	uint64_t OpStart;
+	uint64_t OpEnd;
+	bool OpChip;
+	bool Suspended;
+	uint64_t SuspendBusyEnd;
+	uint64_t Remaining;
+
+} NorModel_t;
+
+typedef struct
+{
+	bool Active;
+	uint8_t *pRx;
+	const uint8_t *pTx;
+	uint32_t Frames;
+	uint8_t Width;
+	bool RxInc;
+	bool TxInc;
+	uint64_t End;
+
+} NorModel_Dma_t;
+
+NorModel_Timing_t NorModel_Timing;
+NorModel_Sfdp_t NorModel_Sfdp;
+NorModel_Stats_t NorModel_Stats;
+const char *NorModel_LastViolation = "";
+
+static NorModel_t Nor;
+static NorModel_Dma_t NorDma;
+static void (*NorTickHook)(void);
+static uint64_t NorNextTick;
+static bool NorTickPending;
+static bool NorInTick;
+static uint32_t NorPrimask;
+static volatile uint16_t *NorPort;
+static void (*NorPortWrite)(uint16_t Data);
+static DWT_Type HostDwtRegs;
+static CoreDebug_Type HostCoreDebugRegs;
+
+uint32_t SystemCoreClock = NOR_CPU_HZ;
+GPIO_TypeDef HostGpioB;
+static SPI_TypeDef HostSpi2;
+// as HAL_SPI_MspInit sets them up for SPI2 on DMA1 channels 4/5
+static DMA_HandleTypeDef HostDmaRx = {{DMA_PDATAALIGN_BYTE, DMA_MDATAALIGN_BYTE, DMA_MINC_ENABLE}};
+static DMA_HandleTypeDef HostDmaTx = {{DMA_PDATAALIGN_BYTE, DMA_MDATAALIGN_BYTE, DMA_MINC_ENABLE}};
+SPI_HandleTypeDef hspi2 = {&HostSpi2, {SPI_DATASIZE_8BIT}, &HostDmaTx, &HostDmaRx, HAL_SPI_STATE_READY};
+//###################################################################################################################
+static void NorModel_Violation(const char *Reason)
+{
+	NorModel_Stats.Violations++;
+	NorModel_LastViolation = Reason;
+}
+//###################################################################################################################
+static void NorModel_RunTick(void)
+{
+	if (!NorTickPending || NorPrimask || NorInTick || (NorTickHook == NULL))
+		return;
+	NorTickPending = false;
+	NorInTick = true;
+	NorTickHook();
+	NorInTick = false;
+}
+//###################################################################################################################
+void NorModel_Advance(uint64_t Ns)
+{
+	Nor.Now += Ns;
+	while (Nor.Now >= NorNextTick)
+	{
+		NorNextTick += NOR_TICK_NS;
+		NorTickPending = true;
+	}
+	NorModel_RunTick();
+}
+//###################################################################################################################
+uint64_t NorModel_Now(void)
+{
+	return Nor.Now;
+}
+//###################################################################################################################
+uint32_t NorModel_Cycles(void)
+{
+	NorModel_Advance(NOR_CALL_NS);
+	return (uint32_t)(Nor.Now * NOR_CPU_HZ / 1000000000ULL);
+}
+//###################################################################################################################
+void NorModel_SetTickHook(void (*Hook)(void))
+{
+	NorTickHook = Hook;
+}
+//###################################################################################################################
+DWT_Type *HostDwt(void)
+{
+	HostDwtRegs.CYCCNT = NorModel_Cycles();
+	return &HostDwtRegs;
+}
+//###################################################################################################################
+CoreDebug_Type *HostCoreDebug(void)
+{
+	return &HostCoreDebugRegs;
+}
+//###################################################################################################################
+uint32_t HAL_GetTick(void)
+{
+	return (uint32_t)(Nor.Now / NOR_TICK_NS);
+}
+//###################################################################################################################
+void HAL_Delay(uint32_t Delay)
+{
+	while (Delay--)
+		NorModel_Advance(NOR_TICK_NS);
+}
+//###################################################################################################################
+uint32_t __get_PRIMASK(void)
+{
+	return NorPrimask;
+}
+//###################################################################################################################
+void __set_PRIMASK(uint32_t priMask)
+{
+	NorPrimask = priMask;
+	NorModel_RunTick();
+}
+//###################################################################################################################
+void __disable_irq(void)
+{
+	NorPrimask = 1;
+}
+//###################################################################################################################
+void __enable_irq(void)
+{
+	__set_PRIMASK(0);
+}
+//###################################################################################################################
+// finishes the program/erase once its time is up
+static void NorModel_Update(void)
+{
+	uint32_t i;
+	if ((Nor.Op == NOR_OP_NONE) || Nor.Suspended || (Nor.Now < Nor.OpEnd))
+		return;
+	if (Nor.Op == NOR_OP_ERASE)
+		memset(&Nor.Mem[Nor.OpAddr], 0xFF, Nor.OpLen);
+	else
+	{
+		for (i = 0; i < 256; i++)
+		{
+			if ((Nor.Mem[Nor.OpAddr + i] & Nor.OpPage[i]) != Nor.OpPage[i])
+				NorModel_Stats.BitsRaised++;
+			Nor.Mem[Nor.OpAddr + i] &= Nor.OpPage[i];
+		}
+	}
+	NorModel_Stats.BusyNs += Nor.OpEnd - Nor.OpStart;
+	Nor.Op = NOR_OP_NONE;
+}
+//###################################################################################################################
+static bool NorModel_Busy(void)
+{
+	NorModel_Update();
+	if (Nor.Suspended)
+		return Nor.Now < Nor.SuspendBusyEnd;
+	return Nor.Op != NOR_OP_NONE;
+}
+//###################################################################################################################
+bool NorModel_IsBusy(void)
+{
+	NorModel_Update();
+	return Nor.Op != NOR_OP_NONE;
+}
+//###################################################################################################################
+bool NorModel_IsSuspended(void)
+{
+	return Nor.Suspended;
+}
+//###################################################################################################################
+static uint8_t NorModel_Status(uint8_t Cmd)
+{
+	switch (Cmd)
+	{
+	case 0x05:
+		return (NorModel_Busy() ? 0x01 : 0) | (Nor.Wel ? 0x02 : 0);
+	case 0x35:
+		return Nor.Suspended ? 0x80 : 0;
+	default:
+		return 0;
+	}
+}
+//###################################################################################################################
+static uint8_t NorModel_CapacityCode(void)
+{
+	return (uint8_t)(__builtin_ctz(Nor.Size) - 17 + 0x11);
+}
+//###################################################################################################################
+// typical time as the 5 bit count and 2 bit unit of the BFPT time fields, rounded up
+static uint32_t NorModel_SfdpTime(uint32_t Us, const uint32_t *UnitMs)
+{
+	uint32_t Ms = (Us + 999) / 1000, Unit = 0, Count;
+	while ((Unit < 3) && ((Ms + UnitMs[Unit] - 1) / UnitMs[Unit] > 32))
+		Unit++;
+	Count = (Ms + UnitMs[Unit] - 1) / UnitMs[Unit];
+	Count = (Count == 0) ? 1 : (Count > 32) ? 32 : Count;
+	return (Unit << 5) | (Count - 1);
+}
+//###################################################################################################################
+// SFDP space: header at 0, one parameter header pointing at the 16 DWORD basic table at 0x80. The fixed
+// DWORDs are a W25Q128JV's, density, erase types and times follow the model.
+static uint8_t NorModel_SfdpByte(uint32_t Addr)
+{
+	static const uint32_t EraseUnit[4] = {1, 16, 128, 1000};
+	static const uint32_t ChipUnit[4] = {16, 256, 4000, 64000};
+	uint32_t Table[48];
+	const uint8_t *Op = NorModel_Sfdp.EraseOpcode;
+	uint32_t *Bfpt = &Table[0x80 / 4];
+	if (Addr >= sizeof(Table))
+		return 0xFF;
+	memset(Table, 0xFF, sizeof(Table));
+	Table[0] = 0x50444653; // "SFDP"
+	Table[1] = 0xFF000106; // rev 1.6, one parameter header
+	Table[2] = 0x10010600; // basic table rev 1.6, 16 DWORDs
+	Table[3] = 0xFF000080;
+	// 4K erase 0x20, 3 byte addresses only up to 16MB, 3 or 4 above
+	Bfpt[0] = (Nor.Size > 0x1000000) ? 0xFFFB20E5 : 0xFFF920E5;
+	Bfpt[1] = Nor.Size * 8 - 1;
+	Bfpt[2] = 0x6B08EB44;
+	Bfpt[3] = 0xBB423B08;
+	Bfpt[4] = 0xFFFFFFFE;
+	Bfpt[5] = 0x0000FFFF;
+	Bfpt[6] = 0xEB40FFFF;
+	Bfpt[7] = (Op[1] << 24) | (0x0F << 16) | (Op[0] << 8) | 0x0C;
+	Bfpt[8] = (Op[2] << 8) | 0x10;
+	// max = 4 x typical
+	Bfpt[9] = 0x01 | (NorModel_SfdpTime(NorModel_Timing.Sector, EraseUnit) << 4) |
+			  (NorModel_SfdpTime(NorModel_Timing.Block32, EraseUnit) << 11) |
+			  (NorModel_SfdpTime(NorModel_Timing.Block64, EraseUnit) << 18);
+	// 256 byte pages, page program in 64 us units
+	Bfpt[10] = 0x81 | ((((NorModel_Timing.PageProgram + 63) / 64 - 1) & 0x1F) << 8) | 0x2000 |
+			   (NorModel_SfdpTime(NorModel_Timing.Chip, ChipUnit) << 24);
+	Bfpt[11] = 0x337663E9;
+	Bfpt[12] = 0x757A757A;
+	Bfpt[13] = 0x5CD5A2F7;
+	Bfpt[14] = 0xFF4DF719;
+	Bfpt[15] = 0x80F830E9;
+	return (uint8_t)(Table[Addr / 4] >> ((Addr & 3) * 8));
+}
+//###################################################################################################################
+// one byte with CS low, Out from the MCU, the return value is what the chip drives on MISO
+static uint8_t NorModel_Byte(uint8_t Out)
+{
+	static const uint8_t UniqId[8] = {0xD1, 0x62, 0x3C, 0x10, 0x47, 0x2E, 0x15, 0x29};
+	uint32_t n = Nor.Count++;
+	uint8_t In = 0xFF;
+	if (n == 0)
+	{
+		NorModel_Stats.Commands[Out]++;
+		Nor.Cmd = Out;
+		Nor.Addr = 0;
+		Nor.PageBytes = 0;
+		memset(Nor.Page, 0xFF, sizeof(Nor.Page));
+		Nor.Ignored = false;
+		if (NorModel_Busy() && (Out != 0x05) && (Out != 0x35) && (Out != 0x15) && (Out != 0x75))
+		{
+			NorModel_Violation("command while BUSY");
+			Nor.Ignored = true;
+		}
+		return In;
+	}
+	if (Nor.Ignored)
+		return In;
+	switch (Nor.Cmd)
+	{
+	case 0x05:
+	case 0x35:
+	case 0x15:
+		return NorModel_Status(Nor.Cmd);
+	case 0x9F:
+		return (n == 1) ? 0xEF : (n == 2) ? 0x40 : (n == 3) ? NorModel_CapacityCode() : 0xFF;
+	case 0x4B:
+		return ((n >= 5) && (n < 13)) ? UniqId[n - 5] : 0xFF;
+	case 0x03:
+	case 0x0B:
+		if (n <= 3)
+		{
+			Nor.Addr = (Nor.Addr << 8) | Out;
+			return In;
+		}
+		if ((Nor.Cmd == 0x0B) && (n == 4))
+			return In;
+		if (Nor.Suspended && (Nor.Addr >= Nor.OpAddr) && (Nor.Addr < Nor.OpAddr + Nor.OpLen))
+			NorModel_Violation("read inside the suspended program/erase");
+		In = Nor.Mem[Nor.Addr % Nor.Size];
+		Nor.Addr++;
+		return In;
+	case 0x02:
+		if (n <= 3)
+		{
+			Nor.Addr = (Nor.Addr << 8) | Out;
+			return In;
+		}
+		if (Nor.PageBytes == 256 - (Nor.Addr & 0xFF))
+			NorModel_Stats.PageWraps++;
+		Nor.Page[(Nor.Addr + Nor.PageBytes) & 0xFF] = Out;
+		Nor.PageBytes++;
+		return In;
+	case 0x20:
+	case 0x52:
+	case 0xD8:
+		if (n <= 3)
+			Nor.Addr = (Nor.Addr << 8) | Out;
+		return In;
+	case 0x5A:
+		if (n <= 3)
+		{
+			Nor.Addr = (Nor.Addr << 8) | Out;
+			return In;
+		}
+		if ((n == 4) || !NorModel_Sfdp.Present)
+			return In;
+		return NorModel_SfdpByte(Nor.Addr++);
+	default:
+		return In;
+	}
+}
+//###################################################################################################################
+static void NorModel_Start(NorModel_Op_t Op, uint32_t Addr, uint32_t Len, uint32_t TimeUs)
+{
+	Nor.Wel = false;
+	Nor.Op = Op;
+	Nor.OpAddr = Addr;
+	Nor.OpLen = Len;
+	Nor.OpChip = (Len == Nor.Size);
+	Nor.OpStart = Nor.Now;
+	Nor.OpEnd = Nor.Now + TimeUs * 1000ULL;
+	Nor.Suspended = false;
+	if (Op == NOR_OP_PROGRAM)
+	{
+		memcpy(Nor.OpPage, Nor.Page, sizeof(Nor.OpPage));
+		NorModel_Stats.Programs++;
+	}
+	else
+		NorModel_Stats.Erases++;
+}
+//###################################################################################################################
+// CS high: program, erase, WREN and suspend/resume take effect here
+static void NorModel_End(void)
+{
+	uint32_t Unit = 0, Time = 0;
+	if (Nor.Ignored || (Nor.Count == 0))
+		return;
+	switch (Nor.Cmd)
+	{
+	case 0x06:
+		Nor.Wel = true;
+		return;
+	case 0x04:
+		Nor.Wel = false;
+		return;
+	case 0x75:
+		if ((Nor.Op == NOR_OP_NONE) || Nor.Suspended)
+			return;
+		if (Nor.OpChip)
+		{
+			NorModel_Violation("suspend of a chip erase");
+			return;
+		}
+		// finishes on its own within tSUS, otherwise it stops with the rest of its time kept
+		if (Nor.OpEnd <= Nor.Now + NorModel_Timing.Suspend * 1000ULL)
+			return;
+		Nor.SuspendBusyEnd = Nor.Now + NorModel_Timing.Suspend * 1000ULL;
+		Nor.Remaining = Nor.OpEnd - Nor.SuspendBusyEnd;
+		Nor.Suspended = true;
+		NorModel_Stats.Suspends++;
+		return;
+	case 0x7A:
+		if (!Nor.Suspended)
+		{
+			NorModel_Violation("resume without suspend");
+			return;
+		}
+		Nor.Suspended = false;
+		Nor.OpStart += Nor.Now - Nor.SuspendBusyEnd;
+		Nor.OpEnd = Nor.Now + Nor.Remaining;
+		NorModel_Stats.Resumes++;
+		return;
+	case 0x02:
+	case 0x20:
+	case 0x52:
+	case 0xD8:
+	case 0xC7:
+	case 0x60:
+		break;
+	default:
+		return;
+	}
+	if (Nor.Suspended)
+	{
+		NorModel_Violation("program/erase while suspended");
+		return;
+	}
+	if (!Nor.Wel)
+	{
+		NorModel_Violation("program/erase without WEL");
+		return;
+	}
+	if (Nor.Cmd == 0x02)
+	{
+		if ((Nor.Count < 5) || (Nor.Addr >= Nor.Size))
+		{
+			NorModel_Violation("page program without data");
+			Nor.Wel = false;
+			return;
+		}
+		NorModel_Start(NOR_OP_PROGRAM, Nor.Addr & ~0xFFUL, 256, NorModel_Timing.PageProgram);
+		return;
+	}
+	if ((Nor.Cmd == 0xC7) || (Nor.Cmd == 0x60))
+	{
+		NorModel_Start(NOR_OP_ERASE, 0, Nor.Size, NorModel_Timing.Chip);
+		return;
+	}
+	if (Nor.Count != 4)
+	{
+		NorModel_Violation("erase with a bad address");
+		Nor.Wel = false;
+		return;
+	}
+	switch (Nor.Cmd)
+	{
+	case 0x20:
+		Unit = 0x1000;
+		Time = NorModel_Timing.Sector;
+		break;
+	case 0x52:
+		Unit = 0x8000;
+		Time = NorModel_Timing.Block32;
+		break;
+	default:
+		Unit = 0x10000;
+		Time = NorModel_Timing.Block64;
+		break;
+	}
+	NorModel_Start(NOR_OP_ERASE, (Nor.Addr % Nor.Size) & ~(Unit - 1), Unit, Time);
+}
+//###################################################################################################################
+static uint8_t NorModel_Xfer(uint8_t Out)
+{
+	if (NorDma.Active)
+		NorModel_Violation("SPI access while DMA runs");
+	NorModel_Advance(NOR_SPI_BYTE_NS);
+	if (!Nor.Selected)
+		return 0xFF;
+	return NorModel_Byte(Out);
+}
+//###################################################################################################################
+// one SPI frame, 16 bit frames go MSB first like DFF=1 on the F1
+static void NorModel_Frame(const uint8_t *pTx, uint8_t *pRx, uint8_t Width)
+{
+	uint16_t Out, In;
+	if (Width == 1)
+	{
+		In = NorModel_Xfer(pTx ? *pTx : 0xFF);
+		if (pRx)
+			*pRx = (uint8_t)In;
+		return;
+	}
+	Out = pTx ? *(const uint16_t *)pTx : 0xFFFF;
+	In = (uint16_t)(NorModel_Xfer(Out >> 8) << 8);
+	In |= NorModel_Xfer(Out & 0xFF);
+	if (pRx)
+		*(uint16_t *)pRx = In;
+}
+//###################################################################################################################
+void NorModel_Init(uint32_t SizeInKiloByte)
+{
+	free(Nor.Mem);
+	memset(&Nor, 0, sizeof(Nor));
+	memset(&NorDma, 0, sizeof(NorDma));
+	memset(&NorModel_Stats, 0, sizeof(NorModel_Stats));
+	NorModel_LastViolation = "";
+	Nor.Size = SizeInKiloByte * 1024;
+	Nor.Mem = malloc(Nor.Size);
+	memset(Nor.Mem, 0xFF, Nor.Size);
+	NorNextTick = NOR_TICK_NS;
+	NorTickPending = false;
+	NorPrimask = 0;
+	NorModel_Timing.PageProgram = 700;
+	NorModel_Timing.Sector = 45000;
+	NorModel_Timing.Block32 = 120000;
+	NorModel_Timing.Block64 = 150000;
+	NorModel_Timing.Chip = 5000000;
+	NorModel_Timing.Suspend = 20;
+	NorModel_Sfdp.Present = true;
+	NorModel_Sfdp.EraseOpcode[0] = 0x20;
+	NorModel_Sfdp.EraseOpcode[1] = 0x52;
+	NorModel_Sfdp.EraseOpcode[2] = 0xD8;
+	HostGpioB.ODR = Flash_CS_Pin;
+	hspi2.State = HAL_SPI_STATE_READY;
+}
+//###################################################################################################################
+uint8_t *NorModel_Array(void)
+{
+	return Nor.Mem;
+}
+//###################################################################################################################
+uint32_t NorModel_Size(void)
+{
+	return Nor.Size;
+}
+//###################################################################################################################
+void HAL_GPIO_WritePin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState)
+{
+	NorModel_Advance(NOR_CALL_NS);
+	if (PinState == GPIO_PIN_SET)
+		GPIOx->ODR |= GPIO_Pin;
+	else
+		GPIOx->ODR &= ~GPIO_Pin;
+	if ((GPIOx != GPIOB) || (GPIO_Pin != Flash_CS_Pin))
+		return;
+	if (NorDma.Active)
+		NorModel_Violation("CS changed while DMA runs");
+	if (PinState == GPIO_PIN_RESET)
+	{
+		if (Nor.Selected)
+			NorModel_Violation("CS low inside a transaction");
+		Nor.Selected = true;
+		Nor.Count = 0;
+		return;
+	}
+	if (!Nor.Selected)
+		return;
+	NorModel_End();
+	Nor.Selected = false;
+}
+//###################################################################################################################
+static uint8_t NorModel_Width(SPI_HandleTypeDef *hspi)
+{
+	return (hspi->Instance->CR1 & SPI_CR1_DFF) ? 2 : 1;
+}
+//###################################################################################################################
+HAL_StatusTypeDef HAL_SPI_TransmitReceive(SPI_HandleTypeDef *hspi, uint8_t *pTxData, uint8_t *pRxData, uint16_t Size, uint32_t Timeout)
+{
+	uint8_t Width = NorModel_Width(hspi);
+	(void)Timeout;
+	if (hspi->State != HAL_SPI_STATE_READY)
+		return HAL_BUSY;
+	hspi->Instance->CR1 |= SPI_CR1_SPE;
+	while (Size--)
+	{
+		NorModel_Frame(pTxData, pRxData, Width);
+		if (pTxData)
+			pTxData += Width;
+		if (pRxData)
+			pRxData += Width;
+	}
+	return HAL_OK;
+}
+//###################################################################################################################
+HAL_StatusTypeDef HAL_SPI_Transmit(SPI_HandleTypeDef *hspi, uint8_t *pData, uint16_t Size, uint32_t Timeout)
+{
+	return HAL_SPI_TransmitReceive(hspi, pData, NULL, Size, Timeout);
+}
+//###################################################################################################################
+HAL_StatusTypeDef HAL_SPI_Receive(SPI_HandleTypeDef *hspi, uint8_t *pData, uint16_t Size, uint32_t Timeout)
+{
+	return HAL_SPI_TransmitReceive(hspi, NULL, pData, Size, Timeout);
+}
+//###################################################################################################################
+// DMA moves the data when the transfer completes, its bus time is accounted up front
+static HAL_StatusTypeDef NorModel_DmaStart(SPI_HandleTypeDef *hspi, const uint8_t *pTx, uint8_t *pRx, uint16_t Size, HAL_SPI_StateTypeDef State)
+{
+	if (hspi->State != HAL_SPI_STATE_READY)
+		return HAL_BUSY;
+	hspi->Instance->CR1 |= SPI_CR1_SPE;
+	NorDma.Active = true;
+	NorDma.pTx = pTx;
+	NorDma.pRx = pRx;
+	NorDma.Frames = Size;
+	NorDma.Width = NorModel_Width(hspi);
+	NorDma.TxInc = hspi->hdmatx->Init.MemInc == DMA_MINC_ENABLE;
+	NorDma.RxInc = hspi->hdmarx->Init.MemInc == DMA_MINC_ENABLE;
+	NorDma.End = Nor.Now + (uint64_t)Size * NorDma.Width * NOR_SPI_BYTE_NS;
+	hspi->State = State;
+	return HAL_OK;
+}
+//###################################################################################################################
+static void NorModel_DmaPoll(SPI_HandleTypeDef *hspi)
+{
+	uint64_t Now = Nor.Now;
+	uint32_t i;
+	if (!NorDma.Active || (Nor.Now < NorDma.End))
+		return;
+	// replay the frames at the time they went over the wire
+	NorDma.Active = false;
+	Nor.Now = NorDma.End - (uint64_t)NorDma.Frames * NorDma.Width * NOR_SPI_BYTE_NS;
+	for (i = 0; i < NorDma.Frames; i++)
+	{
+		NorModel_Frame(NorDma.pTx, NorDma.pRx, NorDma.Width);
+		if (NorDma.pTx && NorDma.TxInc)
+			NorDma.pTx += NorDma.Width;
+		if (NorDma.pRx && NorDma.RxInc)
+			NorDma.pRx += NorDma.Width;
+		else if (NorPortWrite && (NorDma.pRx == (uint8_t *)NorPort))
+			NorPortWrite(*NorPort);
+	}
+	Nor.Now = Now;
+	hspi->State = HAL_SPI_STATE_READY;
+}
+//###################################################################################################################
+HAL_StatusTypeDef HAL_SPI_Transmit_DMA(SPI_HandleTypeDef *hspi, uint8_t *pData, uint16_t Size)
+{
+	return NorModel_DmaStart(hspi, pData, NULL, Size, HAL_SPI_STATE_BUSY_TX);
+}
+//###################################################################################################################
+HAL_StatusTypeDef HAL_SPI_Receive_DMA(SPI_HandleTypeDef *hspi, uint8_t *pData, uint16_t Size)
+{
+	return NorModel_DmaStart(hspi, NULL, pData, Size, HAL_SPI_STATE_BUSY_RX);
+}
+//###################################################################################################################
+HAL_StatusTypeDef HAL_SPI_TransmitReceive_DMA(SPI_HandleTypeDef *hspi, uint8_t *pTxData, uint8_t *pRxData, uint16_t Size)
+{
+	return NorModel_DmaStart(hspi, pTxData, pRxData, Size, HAL_SPI_STATE_BUSY_TX_RX);
+}
+//###################################################################################################################
+HAL_SPI_StateTypeDef HAL_SPI_GetState(SPI_HandleTypeDef *hspi)
+{
+	NorModel_Advance(NOR_CALL_NS);
+	NorModel_DmaPoll(hspi);
+	return hspi->State;
+}
+//###################################################################################################################
+HAL_StatusTypeDef HAL_DMA_Init(DMA_HandleTypeDef *hdma)
+{
+	(void)hdma;
+	return HAL_OK;
+}
+//###################################################################################################################
+void NorModel_SetPort(volatile uint16_t *Port, void (*Write)(uint16_t Data))
+{
+	NorPort = Port;
+	NorPortWrite = Write;
+}
+//###################################################################################################################
+bool NorModel_DmaTargets(const void *pData, uint32_t Len)
+{
+	const uint8_t *p = pData;
+	uint32_t Span;
+	if (!NorDma.Active || (NorDma.pRx == NULL))
+		return false;
+	Span = NorDma.RxInc ? NorDma.Frames * NorDma.Width : NorDma.Width;
+	return (p < NorDma.pRx + Span) && (NorDma.pRx < p + Len);
+}
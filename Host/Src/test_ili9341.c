@@ -0,0 +1,363 @@
+// ili9341 driver against the GRAM model: what lands on the glass in every orientation, read back, blits
+// from the NOR model, the bus words every API call costs, and traces that replay to the same GRAM.
+// Screens go to build/*.ppm, traces for the lcd_trace tool to build/*.trace.
+// Exit code is the number of failed checks.
+#include "host_hal.h"
+#include "nor_model.h"
+#include "lcd_sim.h"
+#include "lcd_trace.h"
+#include "ili9341.h"
+#include "w25qxx.h"
+#include <stdio.h>
+#include <string.h>
+
+static int Failed;
+static int Checked;
+
+#define CHECK(cond)                                                          \
+	do                                                                       \
+	{                                                                        \
+		Checked++;                                                           \
+		if (!(cond))                                                         \
+		{                                                                    \
+			Failed++;                                                        \
+			printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+		}                                                                    \
+	} while (0)
+
+// main.c provides these on the target
+char idx[16];
+int my_htoa32(char *buf, uint32_t data)
+{
+	return sprintf(buf, "%08X", (unsigned)data);
+}
+
+// runs Call and prints the bus words it took, command words (command + parameters) against pixel words
+#define REPORT(Counts, Call)                              \
+	do                                                    \
+	{                                                     \
+		LcdSim_CountsTake();                              \
+		Call;                                             \
+		Counts = LcdSim_CountsTake();                     \
+		Report(#Call, &Counts);                           \
+	} while (0)
+
+static void Report(const char *Name, const LcdSim_Counts_t *Counts)
+{
+	uint32_t Overhead = Counts->Commands + Counts->Params;
+	uint32_t Total = Overhead + Counts->Pixels + Counts->Reads;
+	printf("  %-44.44s %4u cmd %5u param %6u pixel %3u read  %5.1f%% overhead\n", Name, Counts->Commands,
+		   Counts->Params, Counts->Pixels, Counts->Reads, Total ? 100.0 * Overhead / Total : 0.0);
+}
+
+// where the pixel the driver calls (x, y) shows up on the glass
+static void Glass(uint16_t x, uint16_t y, uint16_t *gx, uint16_t *gy)
+{
+	switch (lcdGetOrientation())
+	{
+	case LCD_ORIENTATION_LANDSCAPE:
+		*gx = LCD_SIM_COLUMNS - 1 - y;
+		*gy = x;
+		break;
+	case LCD_ORIENTATION_PORTRAIT_MIRROR:
+		*gx = LCD_SIM_COLUMNS - 1 - x;
+		*gy = LCD_SIM_ROWS - 1 - y;
+		break;
+	case LCD_ORIENTATION_LANDSCAPE_MIRROR:
+		*gx = y;
+		*gy = LCD_SIM_ROWS - 1 - x;
+		break;
+	default:
+		*gx = x;
+		*gy = y;
+		break;
+	}
+}
+
+static uint16_t Shown(uint16_t x, uint16_t y)
+{
+	uint16_t gx, gy;
+	Glass(x, y, &gx, &gy);
+	return LcdSim_Pixel(gx, gy);
+}
+
+// number of glass pixels in Color
+static uint32_t Count(uint16_t Color)
+{
+	uint32_t n = 0;
+	uint16_t x, y;
+	for (y = 0; y < LCD_SIM_ROWS; y++)
+		for (x = 0; x < LCD_SIM_COLUMNS; x++)
+			n += LcdSim_Pixel(x, y) == Color;
+	return n;
+}
+//###################################################################################################################
+static void TestInit(void)
+{
+	NorModel_Init(2048);
+	CHECK(W25qxx_Init());
+	LcdSim_Init(0x5A5A);
+	NorModel_SetPort(&LcdSim_Port, LcdSim_Write);
+	LCD_ILI9341_init();
+	CHECK(Count(COLOR_BLACK) == LCD_SIM_COLUMNS * LCD_SIM_ROWS);
+	CHECK(lcdGetControllerID() == 0x9341);
+	lcdSetOrientation(LCD_ORIENTATION_PORTRAIT);
+	CHECK(LcdSim_Madctl() == (ILI9341_MADCTL_MX | ILI9341_MADCTL_BGR));
+	CHECK(LcdSim_Counts.Outside == 0);
+}
+//###################################################################################################################
+static void TestOrientations(void)
+{
+	static const lcdOrientationTypeDef Orientation[] = {LCD_ORIENTATION_PORTRAIT, LCD_ORIENTATION_LANDSCAPE,
+															LCD_ORIENTATION_PORTRAIT_MIRROR, LCD_ORIENTATION_LANDSCAPE_MIRROR};
+	uint16_t w, h, i;
+	for (i = 0; i < 4; i++)
+	{
+		lcdSetOrientation(Orientation[i]);
+		w = lcdGetWidth();
+		h = lcdGetHeight();
+		lcdFillRGB(COLOR_BLACK);
+		CHECK(Count(COLOR_BLACK) == LCD_SIM_COLUMNS * LCD_SIM_ROWS);
+		// corners and a rectangle, each must show up where the driver's coordinates say
+		lcdDrawPixel(0, 0, COLOR_RED);
+		lcdDrawPixel(w - 1, 0, COLOR_GREEN);
+		lcdDrawPixel(0, h - 1, COLOR_BLUE);
+		lcdFillRect(10, 20, 30, 40, COLOR_YELLOW);
+		CHECK(Shown(0, 0) == COLOR_RED);
+		CHECK(Shown(w - 1, 0) == COLOR_GREEN);
+		CHECK(Shown(0, h - 1) == COLOR_BLUE);
+		CHECK(Shown(10, 20) == COLOR_YELLOW);
+		CHECK(Shown(39, 59) == COLOR_YELLOW);
+		CHECK(Shown(40, 59) == COLOR_BLACK);
+		CHECK(Shown(39, 60) == COLOR_BLACK);
+		CHECK(Count(COLOR_YELLOW) == 30 * 40);
+		CHECK(lcdReadPixel(w - 1, 0) == COLOR_GREEN);
+		CHECK(lcdReadPixel(12, 22) == COLOR_YELLOW);
+		CHECK(lcdReadPixel(0, h - 1) == COLOR_BLUE);
+		// lines clipped at the edges
+		lcdDrawHLine(w - 5, w + 20, h - 1, COLOR_WHITE);
+		lcdDrawVLine(w - 1, h - 5, h + 20, COLOR_WHITE);
+		CHECK(Count(COLOR_WHITE) == 9);
+		CHECK(Shown(w - 1, h - 1) == COLOR_WHITE);
+	}
+	lcdSetOrientation(LCD_ORIENTATION_PORTRAIT);
+	CHECK(LcdSim_Counts.Outside == 0);
+}
+//###################################################################################################################
+static void TestScroll(void)
+{
+	lcdFillRGB(COLOR_BLACK);
+	lcdDrawHLine(0, lcdGetWidth() - 1, 10, COLOR_RED);
+	// the driver has no scroll API, talk to the model directly: 10 lines up, a fixed top line
+	LcdSim_Cmd(ILI9341_VERTICALSCROLING);
+	LcdSim_Write(0);
+	LcdSim_Write(1);
+	LcdSim_Write(LCD_SIM_ROWS >> 8);
+	LcdSim_Write((LCD_SIM_ROWS - 1) & 0xFF);
+	LcdSim_Write(0);
+	LcdSim_Write(0);
+	LcdSim_Cmd(ILI9341_VSCROLLSTARTADDRESS);
+	LcdSim_Write(0);
+	LcdSim_Write(10);
+	CHECK(LcdSim_Pixel(5, 1) == COLOR_RED);
+	CHECK(LcdSim_Pixel(5, 10) == COLOR_BLACK);
+	CHECK(LcdSim_Pixel(5, 0) == COLOR_BLACK);
+	LcdSim_Cmd(ILI9341_VSCROLLSTARTADDRESS);
+	LcdSim_Write(0);
+	LcdSim_Write(1);
+	CHECK(LcdSim_Pixel(5, 10) == COLOR_RED);
+}
+//###################################################################################################################
+static void TestBlit(void)
+{
+	uint8_t *Flash = NorModel_Array();
+	uint16_t x, y, Color;
+	// 16 x 8 gradient at 0x10000, big endian as the 16 bit SPI frames read it
+	for (y = 0; y < 8; y++)
+	{
+		for (x = 0; x < 16; x++)
+		{
+			Color = lcdColor565(x * 16, y * 32, 0x80);
+			Flash[0x10000 + (y * 16 + x) * 2] = Color >> 8;
+			Flash[0x10000 + (y * 16 + x) * 2 + 1] = Color & 0xFF;
+		}
+	}
+	lcdFillRGB(COLOR_BLACK);
+	lcdBlitFromFlash(100, 200, 16, 8, 0x10000);
+	CHECK(Shown(100, 200) == lcdColor565(0, 0, 0x80));
+	CHECK(Shown(115, 207) == lcdColor565(15 * 16, 7 * 32, 0x80));
+	CHECK(Shown(116, 207) == COLOR_BLACK);
+	CHECK(Count(COLOR_BLACK) == LCD_SIM_COLUMNS * LCD_SIM_ROWS - 16 * 8);
+}
+//###################################################################################################################
+// bus words per call, the shadowed window setup shows up as missing CASET/PASET words
+static void TestWords(void)
+{
+	LcdSim_Counts_t c;
+	printf("bus words per call:\n");
+	REPORT(c, lcdFillRGB(COLOR_NAVY));
+	CHECK(c.Pixels == LCD_SIM_COLUMNS * LCD_SIM_ROWS);
+	REPORT(c, lcdDrawPixel(5, 5, COLOR_WHITE));
+	CHECK((c.Commands == 3) && (c.Params == 8) && (c.Pixels == 1));
+	REPORT(c, lcdDrawPixel(6, 5, COLOR_WHITE));
+	CHECK((c.Commands == 2) && (c.Params == 4) && (c.Pixels == 1));
+	REPORT(c, lcdDrawPixel(6, 5, COLOR_WHITE));
+	CHECK((c.Commands == 1) && (c.Params == 0) && (c.Pixels == 1));
+	REPORT(c, lcdDrawHLine(10, 229, 30, COLOR_WHITE));
+	CHECK(c.Pixels == 220);
+	REPORT(c, lcdDrawVLine(10, 30, 309, COLOR_WHITE));
+	CHECK(c.Pixels == 280);
+	REPORT(c, lcdDrawLine(10, 40, 229, 140, COLOR_YELLOW));
+	REPORT(c, lcdDrawRect(20, 150, 200, 60, COLOR_GREEN));
+	REPORT(c, lcdFillRect(30, 160, 60, 40, COLOR_RED));
+	CHECK(c.Pixels == 60 * 40);
+	REPORT(c, lcdDrawCircle(160, 180, 25, COLOR_CYAN));
+	REPORT(c, lcdFillCircle(160, 250, 25, COLOR_MAGENTA));
+	REPORT(c, lcdFillRoundRect(20, 280, 80, 30, 8, COLOR_ORANGE));
+	REPORT(c, lcdDrawTriangle(120, 290, 150, 230, 200, 300, COLOR_WHITE));
+	REPORT(c, lcdDrawChar(20, 60, 'A', COLOR_WHITE, COLOR_NAVY));
+	CHECK(c.Pixels == lcdGetTextFont()->Width * lcdGetTextFont()->Height);
+	REPORT(c, lcdSetCursor(20, 80));
+	REPORT(c, lcdPrintf("GRAM %d", 9341));
+	REPORT(c, lcdBlitFromFlash(150, 60, 16, 8, 0x10000));
+	CHECK(c.Pixels == 16 * 8);
+	REPORT(c, lcdReadPixel(30, 160));
+	CHECK(c.Reads == 3);
+	// same MADCTL: only the full screen window goes out
+	REPORT(c, lcdSetOrientation(LCD_ORIENTATION_PORTRAIT));
+	CHECK((c.Commands == 3) && (c.Params == 8));
+	CHECK(LcdSim_DumpPpm("build/lcd_portrait.ppm"));
+
+	REPORT(c, lcdSetOrientation(LCD_ORIENTATION_LANDSCAPE));
+	CHECK((c.Commands == 4) && (c.Params == 9));
+	REPORT(c, lcdFillRGB(COLOR_DARKGREEN));
+	lcdSetTextColor(COLOR_YELLOW, COLOR_DARKGREEN);
+	lcdSetCursor(10, 10);
+	REPORT(c, lcdPrintf("Landscape %ux%u", lcdGetWidth(), lcdGetHeight()));
+	REPORT(c, lcdDrawRoundRect(10, 40, 300, 180, 12, COLOR_WHITE));
+	REPORT(c, lcdFillTriangle(40, 200, 160, 60, 280, 200, COLOR_ORANGE));
+	CHECK(LcdSim_DumpPpm("build/lcd_landscape.ppm"));
+	lcdSetOrientation(LCD_ORIENTATION_PORTRAIT);
+	CHECK(LcdSim_Counts.Outside == 0);
+}
+//###################################################################################################################
+static LcdTrace_Frame_t Replayed[4];
+static uint32_t ReplayedCount;
+static uint16_t Expect[LCD_SIM_ROWS][LCD_SIM_COLUMNS];
+
+static void KeepFrame(const LcdTrace_Frame_t *Frame, void *Arg)
+{
+	if (ReplayedCount < 4)
+		Replayed[ReplayedCount] = *Frame;
+	ReplayedCount++;
+}
+
+static bool SameGram(void)
+{
+	uint16_t Row, Column;
+	for (Row = 0; Row < LCD_SIM_ROWS; Row++)
+		for (Column = 0; Column < LCD_SIM_COLUMNS; Column++)
+			if (LcdSim_Gram(Column, Row) != Expect[Row][Column])
+				return false;
+	return true;
+}
+
+// traces a 1 frame rectangle on black, for "lcd_trace diff" of two ways to draw it
+static void TraceRect(const char *Path, bool Pixels)
+{
+	const uint16_t *Trace;
+	uint32_t Words;
+	int16_t i;
+	lcdFillRGB(COLOR_BLACK);
+	lcdTraceStart();
+	if (Pixels)
+	{
+		for (i = 0; i < 100; i++)
+		{
+			lcdDrawPixel(20 + i, 20, COLOR_WHITE);
+			lcdDrawPixel(20 + i, 69, COLOR_WHITE);
+		}
+		for (i = 1; i < 49; i++)
+		{
+			lcdDrawPixel(20, 20 + i, COLOR_WHITE);
+			lcdDrawPixel(119, 20 + i, COLOR_WHITE);
+		}
+	}
+	else
+		lcdDrawRect(20, 20, 100, 50, COLOR_WHITE);
+	lcdTraceFrame();
+	Trace = lcdTraceStop(&Words);
+	CHECK(LcdTrace_Save(Path, Trace, Words));
+}
+
+static void TestTrace(void)
+{
+	static const uint16_t Bad[] = {0x002C, 0x4001, 0x1234};
+	LcdSim_Counts_t Live[4];
+	const uint16_t *Trace;
+	uint32_t Words, Bus = 0, i;
+	uint16_t Row, Column;
+
+	// starts in landscape, so the replay only gets it right when the trace carries MADCTL
+	lcdSetOrientation(LCD_ORIENTATION_LANDSCAPE);
+	lcdFillRGB(COLOR_BLACK);
+	LcdSim_CountsTake();
+	lcdTraceStart();
+	lcdFillRGB(COLOR_NAVY);
+	lcdDrawRect(10, 10, 300, 220, COLOR_WHITE);
+	lcdTraceFrame();
+	Live[0] = LcdSim_CountsTake();
+	lcdSetTextColor(COLOR_YELLOW, COLOR_NAVY);
+	lcdSetCursor(20, 20);
+	lcdPrintf("frame %d", 1);
+	lcdFillCircle(160, 140, 40, COLOR_RED);
+	lcdTraceFrame();
+	Live[1] = LcdSim_CountsTake();
+	lcdDrawLine(10, 10, 309, 229, COLOR_GREEN);
+	lcdSetOrientation(LCD_ORIENTATION_PORTRAIT);
+	lcdFillRect(100, 280, 40, 20, COLOR_ORANGE);
+	lcdTraceFrame();
+	Live[2] = LcdSim_CountsTake();
+	lcdDrawPixel(0, 0, COLOR_WHITE);
+	Trace = lcdTraceStop(&Words);
+	Live[3] = LcdSim_CountsTake();
+	for (i = 0; i < 4; i++)
+		Bus += Live[i].Commands + Live[i].Params + Live[i].Pixels;
+	// runs carry the fills, window setups for lines and circles stay word for word
+	CHECK(Words < Bus / 10);
+	CHECK(LcdTrace_Save("build/lcd_scene.trace", Trace, Words));
+
+	for (Row = 0; Row < LCD_SIM_ROWS; Row++)
+		for (Column = 0; Column < LCD_SIM_COLUMNS; Column++)
+			Expect[Row][Column] = LcdSim_Gram(Column, Row);
+	LcdSim_Init(0x1234);
+	ReplayedCount = 0;
+	CHECK(LcdTrace_Replay(Trace, Words, KeepFrame, NULL) == Words);
+	CHECK(SameGram());
+	CHECK(ReplayedCount == 4);
+	for (i = 0; i < 4; i++)
+	{
+		CHECK(Replayed[i].Number == ((i < 3) ? i : LCD_TRACE_TAIL));
+		CHECK(Replayed[i].Bus.Commands == Live[i].Commands);
+		CHECK(Replayed[i].Bus.Params == Live[i].Params);
+		CHECK(Replayed[i].Bus.Pixels == Live[i].Pixels);
+	}
+	CHECK(LcdSim_Madctl() == (ILI9341_MADCTL_MX | ILI9341_MADCTL_BGR));
+	CHECK(LcdTrace_Replay(Bad, 3, NULL, NULL) == 1);
+
+	TraceRect("build/lcd_rect.trace", false);
+	TraceRect("build/lcd_rect_pixels.trace", true);
+	CHECK(LcdSim_Counts.Outside == 0);
+}
+//###################################################################################################################
+int main(void)
+{
+	TestInit();
+	TestOrientations();
+	TestScroll();
+	TestBlit();
+	TestWords();
+	TestTrace();
+	printf("test_ili9341: %d checks, %d failed\n", Checked, Failed);
+	return Failed;
+}
@@ -0,0 +1,574 @@
+// w25qxx driver against the NOR model: the model's own rules, blocking calls, the SPI DMA ping-pong and
+// the SysTick job engine, all on the virtual clock. Exit code is the number of failed checks.
+#include "host_hal.h"
+#include "nor_model.h"
+#include "w25qxxConf.h"
+#include "w25qxx.h"
+#include <stdio.h>
+#include <string.h>
+
+static int Failed;
+static int Checked;
+
+#define CHECK(cond)                                                          \
+	do                                                                       \
+	{                                                                        \
+		Checked++;                                                           \
+		if (!(cond))                                                         \
+		{                                                                    \
+			Failed++;                                                        \
+			printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+		}                                                                    \
+	} while (0)
+
+#define CHECK_NO_VIOLATION()                                                                             \
+	do                                                                                                   \
+	{                                                                                                    \
+		CHECK(NorModel_Stats.Violations == 0);                                                           \
+		if (NorModel_Stats.Violations)                                                                   \
+			printf("    %u violation(s), last: %s\n", NorModel_Stats.Violations, NorModel_LastViolation); \
+	} while (0)
+
+// main.c provides these on the target
+char idx[16];
+int my_htoa32(char *buf, uint32_t data)
+{
+	return sprintf(buf, "%08X", (unsigned)data);
+}
+
+static double Ms(uint64_t Ns)
+{
+	return Ns / 1e6;
+}
+//###################################################################################################################
+static void Cmd(uint8_t Byte)
+{
+	HAL_GPIO_WritePin(GPIOB, Flash_CS_Pin, GPIO_PIN_RESET);
+	HAL_SPI_Transmit(&hspi2, &Byte, 1, 100);
+	HAL_GPIO_WritePin(GPIOB, Flash_CS_Pin, GPIO_PIN_SET);
+}
+
+static void RawProgram(uint32_t Address, const uint8_t *pData, uint16_t Len)
+{
+	uint8_t Header[4] = {0x02, Address >> 16, Address >> 8, Address};
+	HAL_GPIO_WritePin(GPIOB, Flash_CS_Pin, GPIO_PIN_RESET);
+	HAL_SPI_Transmit(&hspi2, Header, 4, 100);
+	HAL_SPI_Transmit(&hspi2, (uint8_t *)pData, Len, 100);
+	HAL_GPIO_WritePin(GPIOB, Flash_CS_Pin, GPIO_PIN_SET);
+}
+
+static uint8_t RawStatus(void)
+{
+	uint8_t Tx[2] = {0x05, 0xFF}, Rx[2];
+	HAL_GPIO_WritePin(GPIOB, Flash_CS_Pin, GPIO_PIN_RESET);
+	HAL_SPI_TransmitReceive(&hspi2, Tx, Rx, 2, 100);
+	HAL_GPIO_WritePin(GPIOB, Flash_CS_Pin, GPIO_PIN_SET);
+	return Rx[1];
+}
+
+static void RawWaitIdle(void)
+{
+	while (RawStatus() & 0x01)
+		NorModel_Advance(10000);
+}
+//###################################################################################################################
+static void TestModelRules(void)
+{
+	uint8_t *Mem;
+	uint8_t Data[10];
+	uint64_t Start;
+	NorModel_Init(2048);
+	Mem = NorModel_Array();
+
+	// no WREN, no program
+	Data[0] = 0x00;
+	RawProgram(0x100, Data, 1);
+	CHECK(NorModel_Stats.Violations == 1);
+	CHECK(Mem[0x100] == 0xFF);
+	CHECK((RawStatus() & 0x03) == 0);
+
+	// WEL set by WREN, cleared when the program starts, BUSY for tPP
+	NorModel_Init(2048);
+	Mem = NorModel_Array();
+	Cmd(0x06);
+	CHECK(RawStatus() & 0x02);
+	Data[0] = 0xF0;
+	Start = NorModel_Now();
+	RawProgram(0x100, Data, 1);
+	CHECK((RawStatus() & 0x03) == 0x01);
+	NorModel_Advance(NorModel_Timing.PageProgram * 1000ULL - (NorModel_Now() - Start) - 1000);
+	CHECK(RawStatus() & 0x01);
+	NorModel_Advance(2000);
+	CHECK((RawStatus() & 0x01) == 0);
+	CHECK(Mem[0x100] == 0xF0);
+
+	// commands other than status reads are dropped while BUSY
+	Cmd(0x06);
+	Data[0] = 0x0F;
+	RawProgram(0x100, Data, 1);
+	Cmd(0x06);
+	CHECK(NorModel_Stats.Violations == 1);
+	RawWaitIdle();
+	CHECK((RawStatus() & 0x02) == 0);
+
+	// programming only clears bits: 0xF0 & 0x0F
+	CHECK(Mem[0x100] == 0x00);
+	CHECK(NorModel_Stats.BitsRaised == 1);
+
+	// data past the page end wraps to its start
+	for (uint8_t i = 0; i < 10; i++)
+		Data[i] = 0xA0 + i;
+	Cmd(0x06);
+	RawProgram(0x2FA, Data, 10);
+	RawWaitIdle();
+	CHECK(NorModel_Stats.PageWraps == 1);
+	CHECK(Mem[0x2FA] == 0xA0);
+	CHECK(Mem[0x2FF] == 0xA5);
+	CHECK(Mem[0x200] == 0xA6);
+	CHECK(Mem[0x203] == 0xA9);
+	CHECK(Mem[0x300] == 0xFF);
+
+	// sector erase takes tSE and only then the array reads 0xFF
+	uint8_t Erase[4] = {0x20, 0x00, 0x02, 0x00};
+	Cmd(0x06);
+	Start = NorModel_Now();
+	HAL_GPIO_WritePin(GPIOB, Flash_CS_Pin, GPIO_PIN_RESET);
+	HAL_SPI_Transmit(&hspi2, Erase, 4, 100);
+	HAL_GPIO_WritePin(GPIOB, Flash_CS_Pin, GPIO_PIN_SET);
+	CHECK(Mem[0x200] == 0xA6);
+	RawWaitIdle();
+	CHECK(NorModel_Now() - Start >= NorModel_Timing.Sector * 1000ULL);
+	CHECK(NorModel_Now() - Start < NorModel_Timing.Sector * 1000ULL + 100000);
+	// the whole 4K sector, not just the page addressed
+	CHECK(Mem[0x200] == 0xFF);
+	CHECK(Mem[0x100] == 0xFF);
+	CHECK(Mem[0x1000] == 0xFF);
+}
+//###################################################################################################################
+static void TestBlocking(void)
+{
+	uint8_t Buf[700], Back[700];
+	uint64_t Start;
+	uint32_t i;
+	NorModel_Init(2048);
+	CHECK(W25qxx_Init());
+	CHECK(w25qxx.ID == W25Q16);
+	CHECK(w25qxx.BlockCount == 32);
+	CHECK(w25qxx.SectorCount == 512);
+
+	for (i = 0; i < sizeof(Buf); i++)
+		Buf[i] = i * 7;
+	Start = NorModel_Now();
+	CHECK(W25qxx_EraseSector(3));
+	CHECK(NorModel_Now() - Start >= NorModel_Timing.Sector * 1000ULL);
+	// pipelined program: 0x3080 + 700 bytes spans 4 pages
+	CHECK(W25qxx_Program(0x3080, Buf, sizeof(Buf)));
+	CHECK(NorModel_Stats.Programs == 4);
+	CHECK(NorModel_Stats.PageWraps == 0);
+	CHECK(memcmp(&NorModel_Array()[0x3080], Buf, sizeof(Buf)) == 0);
+	W25qxx_ReadBytes(Back, 0x3080, sizeof(Back));
+	CHECK(memcmp(Back, Buf, sizeof(Buf)) == 0);
+
+	// the cache sees programs made through the driver
+	W25qxx_ReadByte(&Back[0], 0x3000);
+	CHECK(Back[0] == 0xFF);
+	CHECK(W25qxx_WriteByte(0x5A, 0x3000));
+	W25qxx_ReadByte(&Back[0], 0x3000);
+	CHECK(Back[0] == 0x5A);
+
+	// read-modify-write: 0 -> 1 forces the erase, untouched data survives it
+	W25qxx_Update(0x3081, (const uint8_t *)"\xFF\xFF", 2);
+	CHECK(W25qxx_UpdateFlush());
+	W25qxx_ReadBytes(Back, 0x3080, sizeof(Back));
+	CHECK(Back[0] == Buf[0]);
+	CHECK((Back[1] == 0xFF) && (Back[2] == 0xFF));
+	CHECK(memcmp(&Back[3], &Buf[3], sizeof(Buf) - 3) == 0);
+
+	// an erase slower than its timeout is reported, not dropped
+	NorModel_Timing.Sector = 600000;
+	CHECK(!W25qxx_EraseSector(4));
+	CHECK(w25qxx.Timeouts == 1);
+	NorModel_Timing.Sector = 45000;
+	HAL_Delay(200);
+	CHECK(!NorModel_IsBusy());
+	CHECK_NO_VIOLATION();
+}
+//###################################################################################################################
+// geometry and erase times from the model's SFDP tables, the JEDEC ID fallback without them
+static void TestSfdp(void)
+{
+	uint32_t i;
+	NorModel_Init(2048);
+	CHECK(W25qxx_Init());
+	CHECK(w25qxx.Sfdp);
+	CHECK(w25qxx.ID == W25Q16);
+	CHECK(w25qxx.BlockCount == 32);
+	// 45/120/150 ms and 5 s rounded up to the 16 ms and 256 ms units of the table
+	CHECK(w25qxx.EraseTime[0] == 48);
+	CHECK(w25qxx.EraseTime[1] == 128);
+	CHECK(w25qxx.EraseTime[2] == 160);
+	CHECK(w25qxx.EraseTime[3] == 5120);
+	CHECK_NO_VIOLATION();
+
+	NorModel_Init(8192);
+	NorModel_Timing.Sector = 30000;
+	CHECK(W25qxx_Init());
+	CHECK(w25qxx.ID == W25Q64);
+	CHECK(w25qxx.BlockCount == 128);
+	CHECK(w25qxx.CapacityInKiloByte == 8192);
+	CHECK(w25qxx.EraseTime[0] == 30);
+
+	// 32K erase listed under an opcode the driver does not send: a half block goes out as 8 sector erases
+	NorModel_Init(2048);
+	NorModel_Sfdp.EraseOpcode[1] = 0x53;
+	CHECK(W25qxx_Init());
+	CHECK(w25qxx.EraseTime[1] == 0xFFFFFFFF);
+	CHECK(w25qxx.EraseTime[2] == 160);
+	memset(NorModel_Array(), 0x00, 0x8000);
+	CHECK(W25qxx_EraseRange(0, 0x8000, false));
+	CHECK(NorModel_Stats.Erases == 8);
+	for (i = 0; (i < 0x8000) && (NorModel_Array()[i] == 0xFF); i++)
+		;
+	CHECK(i == 0x8000);
+	CHECK_NO_VIOLATION();
+
+	NorModel_Init(2048);
+	NorModel_Sfdp.Present = false;
+	CHECK(W25qxx_Init());
+	CHECK(!w25qxx.Sfdp);
+	CHECK(w25qxx.ID == W25Q16);
+	CHECK(w25qxx.BlockCount == 32);
+	CHECK(w25qxx.EraseTime[0] == 45);
+	CHECK(w25qxx.EraseTime[3] == 5000);
+}
+//###################################################################################################################
+static uint32_t EraseMark[3];
+
+static void EraseMarkSet(void)
+{
+	EraseMark[0] = NorModel_Stats.Commands[0x20];
+	EraseMark[1] = NorModel_Stats.Commands[0x52];
+	EraseMark[2] = NorModel_Stats.Commands[0xD8];
+}
+
+// 4K, 32K and 64K erases sent since EraseMarkSet
+static bool ErasesSent(uint32_t Sectors, uint32_t Halves, uint32_t Blocks)
+{
+	return (NorModel_Stats.Commands[0x20] - EraseMark[0] == Sectors) && (NorModel_Stats.Commands[0x52] - EraseMark[1] == Halves) &&
+		   (NorModel_Stats.Commands[0xD8] - EraseMark[2] == Blocks);
+}
+
+// EraseRange picks 4K/32K/64K erases by cost and skips blank sectors, IsEmptyRange, ReadBatch merging
+static void TestRanges(void)
+{
+	uint32_t Reads, i;
+	uint8_t *Mem;
+	uint8_t A[4], B[8], C[16], D[4], E[4], F[4], G[4];
+	W25qxx_ReadReq_t Req[7] = {
+		{0x100, A, 4}, {0x108, B, 8}, {0x200, C, 16}, {0x210, D, 4}, {0x100, E, 4},
+		{0x300, F, 4}, {0x304 + _W25QXX_MERGE_GAP, G, 4}};
+	NorModel_Init(2048);
+	CHECK(W25qxx_Init());
+	Mem = NorModel_Array();
+	memset(Mem, 0x00, 0x30000);
+
+	// sectors 1..3 with sector 2 blank: two sector erases, the neighbours keep their data
+	memset(&Mem[0x2000], 0xFF, 0x1000);
+	EraseMarkSet();
+	CHECK(W25qxx_EraseRange(0x1000, 0x3000, true));
+	CHECK(ErasesSent(2, 0, 0));
+	CHECK(W25qxx_IsEmptyRange(0x1000, 0x3000));
+	CHECK((Mem[0x0FFF] == 0x00) && (Mem[0x4000] == 0x00));
+	// nothing left to do
+	EraseMarkSet();
+	CHECK(W25qxx_EraseRange(0x1000, 0x3000, true));
+	CHECK(ErasesSent(0, 0, 0));
+
+	// a whole dirty 64K block is one block erase, a dirty 32K half of the next one a half block erase
+	EraseMarkSet();
+	CHECK(W25qxx_EraseRange(0x10000, 0x18000, true));
+	CHECK(ErasesSent(0, 1, 1));
+	CHECK(W25qxx_IsEmptyRange(0x10000, 0x18000));
+	CHECK(!W25qxx_IsEmptyRange(0x28000, 0x8000));
+	CHECK(Mem[0x28000] == 0x00);
+	CHECK_NO_VIOLATION();
+
+	// IsEmptyRange: one fast read, unaligned edges, the first and last byte count
+	Reads = NorModel_Stats.Commands[0x0B];
+	CHECK(W25qxx_IsEmptyRange(0x11003, 13));
+	Mem[0x1100F] = 0xFE;
+	CHECK(!W25qxx_IsEmptyRange(0x11003, 13));
+	CHECK(W25qxx_IsEmptyRange(0x11003, 12));
+	Mem[0x11003] = 0x7F;
+	CHECK(!W25qxx_IsEmptyRange(0x11003, 1));
+	CHECK(W25qxx_IsEmptyRange(0x11004, 11));
+	CHECK(NorModel_Stats.Commands[0x0B] - Reads == 5);
+
+	// ReadBatch: gaps up to _W25QXX_MERGE_GAP stay in one read, going backwards or further starts a new one
+	for (i = 0; i < 0x400; i++)
+		Mem[i] = i * 13 + 7;
+	Reads = NorModel_Stats.Commands[0x0B];
+	W25qxx_ReadBatch(Req, 7);
+	// 0x100 + 0x108 | 0x200 + 0x210 | 0x100 | 0x300 + the one a full gap behind
+	CHECK(NorModel_Stats.Commands[0x0B] - Reads == 4);
+	for (i = 0; i < 7; i++)
+		CHECK(memcmp(Req[i].pBuffer, &Mem[Req[i].Address], Req[i].Len) == 0);
+	Req[6].Address++;
+	Reads = NorModel_Stats.Commands[0x0B];
+	W25qxx_ReadBatch(&Req[5], 2);
+	CHECK(NorModel_Stats.Commands[0x0B] - Reads == 2);
+	CHECK(G[0] == Mem[Req[6].Address]);
+	CHECK_NO_VIOLATION();
+}
+//###################################################################################################################
+static uint32_t SinkAddress;
+static uint32_t SinkCalls;
+static uint32_t SinkOverlapped;
+static bool SinkOk;
+
+static void Sink(uint8_t *pData, uint32_t Len)
+{
+	// the chunk handed out is complete and no longer a DMA target, the next one is already on the wire
+	if (NorModel_DmaTargets(pData, Len) || (memcmp(pData, &NorModel_Array()[SinkAddress], Len) != 0))
+		SinkOk = false;
+	if (HAL_SPI_GetState(&hspi2) != HAL_SPI_STATE_READY)
+		SinkOverlapped++;
+	SinkAddress += Len;
+	SinkCalls++;
+	// the sink takes a while, longer than one chunk on the wire
+	NorModel_Advance(150000);
+}
+
+static void TestDma(void)
+{
+	uint16_t Pixels[300], Back[300];
+	volatile uint16_t Port = 0;
+	uint32_t i;
+	NorModel_Init(2048);
+	CHECK(W25qxx_Init());
+	for (i = 0; i < 5000; i++)
+		NorModel_Array()[0x10000 + i] = (uint8_t)(i * 13 + (i >> 8));
+
+	// ping-pong: chunks come in order, each once its own transfer completed, with the next one running
+	SinkAddress = 0x10000 + 3;
+	SinkCalls = 0;
+	SinkOverlapped = 0;
+	SinkOk = true;
+	W25qxx_ReadStreamDMA(0x10000 + 3, 4000, Sink);
+	CHECK(SinkOk);
+	CHECK(SinkAddress == 0x10000 + 3 + 4000);
+	CHECK(SinkCalls == (4000 + _W25QXX_STREAM_CHUNK - 1) / _W25QXX_STREAM_CHUNK);
+	CHECK(SinkOverlapped == SinkCalls - 1);
+
+	// pixels go out swapped by DMA and come back in 16 bit frames
+	for (i = 0; i < 300; i++)
+		Pixels[i] = 0xF800 + i;
+	CHECK(!W25qxx_WritePixels(Pixels, 0x20001, 300));
+	CHECK(W25qxx_WritePixels(Pixels, 0x20000, 300));
+	CHECK((NorModel_Array()[0x20000] == 0xF8) && (NorModel_Array()[0x20001] == 0x00));
+	W25qxx_ReadPixels(Back, 0x20000, 300);
+	CHECK(memcmp(Back, Pixels, sizeof(Pixels)) == 0);
+	W25qxx_ReadStreamToPort(0x20000, &Port, 300);
+	CHECK(Port == Pixels[299]);
+	CHECK((hspi2.Instance->CR1 & SPI_CR1_DFF) == 0);
+	CHECK_NO_VIOLATION();
+}
+//###################################################################################################################
+static W25qxx_Job_t *Finished[4];
+static uint32_t FinishedCount;
+static uint64_t FinishedAt[4];
+
+static void JobDone(W25qxx_Job_t *Job)
+{
+	if (FinishedCount < 4)
+	{
+		FinishedAt[FinishedCount] = NorModel_Now();
+		Finished[FinishedCount++] = Job;
+	}
+}
+
+static void RunUntil(W25qxx_Job_t *Job, uint32_t MaxMs)
+{
+	while (!W25qxx_JobIsFinished(Job) && MaxMs--)
+		HAL_Delay(1);
+}
+
+static void TestJobs(void)
+{
+	static uint8_t Data[1024];
+	W25qxx_Job_t Erase = {0}, Program = {0}, Housekeeping = {0};
+	uint8_t Back[16];
+	uint64_t Start, ReadStart;
+	uint32_t i;
+	NorModel_Init(2048);
+	CHECK(W25qxx_Init());
+	NorModel_SetTickHook(W25qxx_JobProcess);
+	for (i = 0; i < sizeof(Data); i++)
+		Data[i] = i ^ 0x55;
+	FinishedCount = 0;
+
+	// one erase command, done on the first tick after tSE
+	Erase.Type = W25QXX_JOB_ERASE_SECTOR;
+	Erase.Address = 0x1000;
+	Erase.Len = 1;
+	Erase.Priority = W25QXX_PRIO_BACKGROUND;
+	Erase.Callback = JobDone;
+	Start = NorModel_Now();
+	CHECK(W25qxx_JobSubmit(&Erase));
+	RunUntil(&Erase, 100);
+	CHECK(Erase.State == W25QXX_JOB_DONE);
+	CHECK(Ms(FinishedAt[0] - Start) >= NorModel_Timing.Sector / 1000.0);
+	CHECK(Ms(FinishedAt[0] - Start) <= NorModel_Timing.Sector / 1000.0 + 2);
+	CHECK(NorModel_Stats.Erases == 1);
+
+	// one page per tick: 4 pages take 4 ticks plus the last tPP
+	Program.Type = W25QXX_JOB_PROGRAM;
+	Program.Address = 0x1000;
+	Program.pBuffer = Data;
+	Program.Len = sizeof(Data);
+	Program.Priority = W25QXX_PRIO_INTERACTIVE;
+	Program.Callback = JobDone;
+	Start = NorModel_Now();
+	CHECK(W25qxx_JobSubmit(&Program));
+	RunUntil(&Program, 100);
+	CHECK(Program.State == W25QXX_JOB_DONE);
+	CHECK(Ms(FinishedAt[1] - Start) <= 6);
+	CHECK(NorModel_Stats.Programs == 4);
+	CHECK(memcmp(&NorModel_Array()[0x1000], Data, sizeof(Data)) == 0);
+
+	// lower class value first, whatever the submit order
+	FinishedCount = 0;
+	Housekeeping = Erase;
+	Housekeeping.Address = 0x5000;
+	Housekeeping.Priority = W25QXX_PRIO_HOUSEKEEPING;
+	Program.Address = 0x6000;
+	Program.Len = 256;
+	CHECK(W25qxx_JobSubmit(&Housekeeping));
+	CHECK(W25qxx_JobSubmit(&Program));
+	RunUntil(&Housekeeping, 100);
+	CHECK((FinishedCount == 2) && (Finished[0] == &Program) && (Finished[1] == &Housekeeping));
+
+	// a read clear of the running erase suspends it instead of waiting tSE
+	Erase.Address = 0x7000;
+	CHECK(W25qxx_JobSubmit(&Erase));
+	HAL_Delay(5);
+	CHECK(Erase.State == W25QXX_JOB_BUSY);
+	Start = NorModel_Now();
+	W25qxx_ReadBytes(Back, 0x1000, 16);
+	CHECK(memcmp(Back, Data, 16) == 0);
+	CHECK(Ms(NorModel_Now() - Start) < 1);
+	CHECK((NorModel_Stats.Suspends == 1) && (NorModel_Stats.Resumes == 1));
+	RunUntil(&Erase, 100);
+	CHECK(Erase.State == W25QXX_JOB_DONE);
+
+	// a cached read of a page the job touches waits for the job, then sees its data
+	W25qxx_ReadByte(&Back[0], 0x8000);
+	Program.Address = 0x8010;
+	Program.Len = 16;
+	CHECK(W25qxx_JobSubmit(&Program));
+	HAL_Delay(1);
+	CHECK(Program.State == W25QXX_JOB_BUSY);
+	ReadStart = NorModel_Now();
+	W25qxx_ReadByte(&Back[0], 0x8000);
+	CHECK(Program.State == W25QXX_JOB_DONE);
+	CHECK(NorModel_Now() - ReadStart >= NorModel_Timing.PageProgram * 1000ULL / 2);
+	W25qxx_ReadBytes(Back, 0x8010, 16);
+	CHECK(memcmp(Back, Data, 16) == 0);
+
+	// a read inside the erase range waits for it and reads erased flash
+	Erase.Address = 0x1000;
+	CHECK(W25qxx_JobSubmit(&Erase));
+	HAL_Delay(2);
+	ReadStart = NorModel_Now();
+	W25qxx_ReadBytes(Back, 0x1000, 16);
+	CHECK(Erase.State == W25QXX_JOB_DONE);
+	CHECK(Ms(NorModel_Now() - ReadStart) >= NorModel_Timing.Sector / 1000.0 - 3);
+	CHECK((Back[0] == 0xFF) && (Back[15] == 0xFF));
+	CHECK(NorModel_Stats.Suspends == 1);
+	NorModel_SetTickHook(NULL);
+	CHECK_NO_VIOLATION();
+}
+//###################################################################################################################
+static void TestJobErrors(void)
+{
+	static uint8_t Data[16] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16};
+	W25qxx_Job_t Job = {0}, Next = {0};
+	uint8_t Back[16];
+	uint32_t Timeouts;
+	NorModel_Init(2048);
+	CHECK(W25qxx_Init());
+	NorModel_SetTickHook(W25qxx_JobProcess);
+
+	// empty ranges and ranges past the end are refused before a command goes out
+	Job.Type = W25QXX_JOB_ERASE_SECTOR;
+	Job.Address = 0x2000;
+	Job.Len = 0;
+	Job.Priority = W25QXX_PRIO_BACKGROUND;
+	CHECK(!W25qxx_JobSubmit(&Job));
+	Job.Type = W25QXX_JOB_ERASE_BLOCK;
+	CHECK(!W25qxx_JobSubmit(&Job));
+	Job.Type = W25QXX_JOB_PROGRAM;
+	Job.pBuffer = Data;
+	CHECK(!W25qxx_JobSubmit(&Job));
+	Job.Len = sizeof(Data);
+	Job.Address = NorModel_Size() - 8;
+	CHECK(!W25qxx_JobSubmit(&Job));
+	Job.Address = NorModel_Size();
+	CHECK(!W25qxx_JobSubmit(&Job));
+	Job.Type = W25QXX_JOB_ERASE_SECTOR;
+	Job.Address = 0xFFFFF000;
+	Job.Len = 0x2000;
+	CHECK(!W25qxx_JobSubmit(&Job));
+	HAL_Delay(5);
+	CHECK((NorModel_Stats.Erases == 0) && (NorModel_Stats.Programs == 0));
+	// the last bytes of the chip are fine
+	Job.Type = W25QXX_JOB_PROGRAM;
+	Job.Address = NorModel_Size() - sizeof(Data);
+	Job.Len = sizeof(Data);
+	CHECK(W25qxx_JobSubmit(&Job));
+	RunUntil(&Job, 10);
+	CHECK(Job.State == W25QXX_JOB_DONE);
+	CHECK(memcmp(&NorModel_Array()[NorModel_Size() - sizeof(Data)], Data, sizeof(Data)) == 0);
+
+	// a sector erase that overruns its timeout: the job fails once BUSY drops, its second sector is never
+	// started and the next job only starts on an idle chip
+	memset(&NorModel_Array()[0x3000], 0x00, 0x2000);
+	NorModel_Timing.Sector = (_W25QXX_TIMEOUT_SECTOR_MS + 100) * 1000;
+	Timeouts = w25qxx.Timeouts;
+	Job.Type = W25QXX_JOB_ERASE_SECTOR;
+	Job.Address = 0x3000;
+	Job.Len = 0x2000;
+	Next.Type = W25QXX_JOB_PROGRAM;
+	Next.Address = 0x6000;
+	Next.pBuffer = Data;
+	Next.Len = sizeof(Data);
+	Next.Priority = W25QXX_PRIO_BACKGROUND;
+	CHECK(W25qxx_JobSubmit(&Job));
+	CHECK(W25qxx_JobSubmit(&Next));
+	HAL_Delay(_W25QXX_TIMEOUT_SECTOR_MS + 10);
+	CHECK(w25qxx.Timeouts == Timeouts + 1);
+	CHECK(Job.State == W25QXX_JOB_BUSY);
+	RunUntil(&Job, 200);
+	CHECK(Job.State == W25QXX_JOB_ERROR);
+	CHECK(!NorModel_IsBusy());
+	CHECK((NorModel_Array()[0x3000] == 0xFF) && (NorModel_Array()[0x4000] == 0x00));
+	RunUntil(&Next, 10);
+	CHECK(Next.State == W25QXX_JOB_DONE);
+	W25qxx_ReadBytes(Back, 0x6000, sizeof(Back));
+	CHECK(memcmp(Back, Data, sizeof(Data)) == 0);
+	NorModel_SetTickHook(NULL);
+	CHECK_NO_VIOLATION();
+}
+//###################################################################################################################
+int main(void)
+{
+	TestModelRules();
+	TestBlocking();
+	TestSfdp();
+	TestRanges();
+	TestDma();
+	TestJobs();
+	TestJobErrors();
+	printf("test_w25qxx: %d checks, %d failed\n", Checked, Failed);
+	return Failed;
+}